@@ -0,0 +1,325 @@
+/*
+  Name: arena.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Bump allocator backing result set storage
+               Memory is handed out from large blocks and never freed one
+               allocation at a time, the whole arena is dropped at once
+               when the result set is reset for the next statement
+               Past an optional budget blocks come from a spill file
+               and large buffers get blocks of their own that are
+               handed back as soon as they are outgrown
+*/
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#include "spill.h"
+
+// default size in bytes of each block the arena takes from the heap
+#if !defined(ODBC_ARENA_BLOCK)
+    #define ODBC_ARENA_BLOCK 65536
+#endif
+
+// Not thread safe, an arena belongs to a single result set
+class arena
+{
+    public:
+        arena() : _pos(0), _allocations(0), _heap_allocations(0), _used(0), _budget(0), _heap(0) {}
+        ~arena() { release(); }
+
+        arena(const arena&) = delete;
+        arena &operator=(const arena&) = delete;
+
+        // returns bytes aligned to align, requests larger than a block
+        // get a block of their own
+        void *allocate(size_t bytes, size_t align)
+        {
+            uintptr_t p;
+
+            ++_allocations;
+            _used += bytes;
+
+            // with a budget set memory counts for more than the number of
+            // heap allocations, so large buffers are kept apart for recycle()
+            if(_budget && bytes > ODBC_ARENA_BLOCK)
+            {
+                _own.push_back(take(bytes + align));
+                p = ((uintptr_t)_own.back().data + align - 1) & ~(uintptr_t)(align - 1);
+
+                return (void*)p;
+            }
+
+            if(!_blocks.empty())
+            {
+                p = ((uintptr_t)_blocks.back().data + _pos + align - 1) & ~(uintptr_t)(align - 1);
+
+                if(p + bytes <= (uintptr_t)_blocks.back().data + _blocks.back().size)
+                {
+                    _pos = p + bytes - (uintptr_t)_blocks.back().data;
+                    return (void*)p;
+                }
+            }
+
+            grow(bytes + align);
+
+            p = ((uintptr_t)_blocks.back().data + align - 1) & ~(uintptr_t)(align - 1);
+            _pos = p + bytes - (uintptr_t)_blocks.back().data;
+
+            return (void*)p;
+        }
+
+        // hands back storage of bytes from allocate() that is no longer
+        // used, a buffer with a block of its own has the block freed, or
+        // unmapped from the spill file, straight away, anything else is
+        // left until reset() as there is no freeing a bump allocation
+        void recycle(void *p, size_t bytes)
+        {
+            size_t i;
+
+            if(bytes <= ODBC_ARENA_BLOCK) return;
+
+            for(i=0;i<_own.size();++i)
+            {
+                if((unsigned char*)p >= _own[i].data && (unsigned char*)p < _own[i].data + _own[i].size)
+                    break;
+            }
+
+            if(i == _own.size()) return;
+
+            drop(_own[i]);
+            _own[i] = _own.back();
+            _own.pop_back();
+        }
+
+        // frees every block but the newest one on the heap, which is kept
+        // so the next result set of a similar size needs no heap
+        // allocation at all, spilled blocks are all dropped
+        void reset()
+        {
+            block last;
+            size_t i = _blocks.size();
+
+            while(i && _blocks[i-1].spilled) --i;
+            if(!i) { release(); return; }
+
+            last = _blocks[i-1];
+            _blocks.erase(_blocks.begin() + (i-1));
+            release();
+            _blocks.push_back(last);
+            _heap = last.size;
+        }
+
+        // frees every block
+        void release()
+        {
+            for(size_t i=0;i<_blocks.size();++i)
+                if(!_blocks[i].spilled) ::operator delete(_blocks[i].data);
+
+            for(size_t i=0;i<_own.size();++i)
+                if(!_own[i].spilled) ::operator delete(_own[i].data);
+
+            if(_spill) _spill->clear();
+
+            _blocks.clear();
+            _own.clear();
+            _pos = 0;
+            _used = 0;
+            _heap = 0;
+        }
+
+        // once the blocks on the heap add up to bytes, further blocks are
+        // mapped from a temporary file, 0 (the default) never spills
+        // Blocks already taken stay where they are, if the file can't be
+        // created or grown the block comes from the heap after all
+        // Without a budget a growing buffer leaves its outgrown copies in
+        // the arena until reset(), up to as many bytes again as the buffer,
+        // with one buffers over a block are freed as they are outgrown
+        void set_budget(size_t bytes) { _budget = bytes; }
+        size_t budget() const { return _budget; }
+
+        // number of allocations served since construction
+        size_t allocations() const { return _allocations; }
+        // number of blocks taken from the heap since construction
+        size_t heap_allocations() const { return _heap_allocations; }
+        // bytes handed out since the last reset
+        size_t bytes_used() const { return _used; }
+        // bytes held in blocks on the heap
+        size_t bytes_heap() const { return _heap; }
+        // bytes held in blocks mapped from the spill file
+        size_t bytes_spilled() const { return _spill ? _spill->size() : 0; }
+        // bytes held in blocks, heap and spilled
+        size_t bytes_reserved() const
+        {
+            size_t bytes = 0;
+
+            for(size_t i=0;i<_blocks.size();++i)
+                bytes += _blocks[i].size;
+
+            for(size_t i=0;i<_own.size();++i)
+                bytes += _own[i].size;
+
+            return bytes;
+        }
+
+    private:
+        struct block
+        {
+            unsigned char *data;
+            size_t size;
+            bool spilled;
+        };
+
+        std::vector<block> _blocks;
+        // blocks holding a single large buffer each, see recycle()
+        std::vector<block> _own;
+        // offset of the next free byte in the newest block
+        size_t _pos;
+        size_t _allocations;
+        size_t _heap_allocations;
+        size_t _used;
+        size_t _budget;
+        size_t _heap;
+        // created on the first block past the budget
+        std::unique_ptr<spill_file> _spill;
+
+        // blocks double with every one taken up to 64 times the first so
+        // a large result set needs few of them without leaving much unused,
+        // a request larger than that gets a block of its own
+        void grow(size_t bytes)
+        {
+            size_t size = _blocks.empty() ? ODBC_ARENA_BLOCK : _blocks.back().size * 2;
+
+            if(size > (size_t)ODBC_ARENA_BLOCK * 64) size = (size_t)ODBC_ARENA_BLOCK * 64;
+            if(size < bytes) size = bytes;
+
+            _blocks.push_back(take(size));
+            _pos = 0;
+        }
+
+        // takes a block of at least size bytes, from the spill file once
+        // the heap blocks have reached the budget
+        block take(size_t size)
+        {
+            block b;
+
+            b.size = size;
+            b.data = 0;
+            b.spilled = false;
+
+            if(_budget && _heap + b.size > _budget)
+            {
+                b.size = (b.size + spill_file::granularity - 1) / spill_file::granularity * spill_file::granularity;
+
+                if(!_spill) _spill.reset(new spill_file());
+                b.data = (unsigned char*)_spill->map(b.size);
+                b.spilled = b.data != 0;
+            }
+
+            if(!b.data)
+            {
+                b.data = (unsigned char*)::operator new(b.size);
+                ++_heap_allocations;
+                _heap += b.size;
+            }
+
+            return b;
+        }
+
+        void drop(const block &b)
+        {
+            if(b.spilled)
+                _spill->unmap(b.data);
+            else
+            {
+                ::operator delete(b.data);
+                _heap -= b.size;
+            }
+        }
+};
+
+// Growable array of trivially copyable values allocated out of an
+// arena, values are moved with memcpy when it grows and old storage is
+// handed back to the arena, without an arena it falls back to the heap
+template<class T>
+class arena_array
+{
+    public:
+        arena_array() : _arena(0), _data(0), _size(0), _capacity(0) {}
+        explicit arena_array(arena *a) : _arena(a), _data(0), _size(0), _capacity(0) {}
+        // the copy allocates out of the same arena
+        arena_array(const arena_array &other) : _arena(other._arena), _data(0), _size(0), _capacity(0)
+        {
+            append(other._data, other._size);
+        }
+        ~arena_array() { if(!_arena) ::operator delete(_data); }
+
+        arena_array &operator=(const arena_array &rhs)
+        {
+            if(this != &rhs)
+            {
+                _size = 0;
+                append(rhs._data, rhs._size);
+            }
+
+            return *this;
+        }
+
+        // appends n values
+        void append(const T *values, size_t n)
+        {
+            if(_size + n > _capacity) reserve(_size + n);
+            if(n) memcpy(_data + _size, values, n*sizeof(T));
+            _size += n;
+        }
+
+        void push_back(T value)
+        {
+            if(_size == _capacity) reserve(_size + 1);
+            _data[_size++] = value;
+        }
+
+        // grows to at least n values, doubling so appends stay amortised O(1)
+        void reserve(size_t n)
+        {
+            T *p;
+
+            if(n <= _capacity) return;
+            if(n < _capacity*2) n = _capacity*2;
+            if(n < 16) n = 16;
+
+            p = (T*)(_arena ? _arena->allocate(n*sizeof(T), alignof(T)) : ::operator new(n*sizeof(T)));
+
+            if(_size) memcpy(p, _data, _size*sizeof(T));
+            if(_arena) _arena->recycle(_data, _capacity*sizeof(T));
+            else ::operator delete(_data);
+
+            _data = p;
+            _capacity = n;
+        }
+
+        void clear() { _size = 0; }
+
+        T &operator[](size_t i) { return _data[i]; }
+        const T &operator[](size_t i) const { return _data[i]; }
+        T *data() { return _data; }
+        const T *data() const { return _data; }
+        size_t size() const { return _size; }
+        size_t capacity() const { return _capacity; }
+
+    private:
+        arena *_arena;
+        T *_data;
+        size_t _size;
+        size_t _capacity;
+};
+
+
+#endif
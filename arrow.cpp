@@ -0,0 +1,675 @@
+#include "headers\odbc.h"
+
+/*************
+* FLATBUFFER *
+**************/
+
+// Arrow's metadata is flatbuffers, the handful of tables it needs are
+// built as a tree and laid out front to back, each table before the
+// children it points at so every offset points forward as required
+// Scalars are written in host order, which is little endian everywhere
+// this builds
+struct fb_node
+{
+	enum node_kind { fb_table, fb_string, fb_structs, fb_tables };
+
+	// one table field, child set for offsets to strings, vectors and
+	// tables, value holds scalars of size bytes otherwise
+	struct fb_field
+	{
+		int slot;
+		size_t size;
+		unsigned char value[8];
+		fb_node *child;
+	};
+
+	node_kind kind;
+	std::vector<fb_field> fields;
+	// string bytes or packed structs of struct_align alignment
+	std::string bytes;
+	size_t count;
+	size_t struct_align;
+	std::vector<fb_node*> items;
+
+	fb_node(node_kind k) : kind(k), count(0), struct_align(1) {}
+
+	template<class T>
+	fb_node *scalar(int slot, T v)
+	{
+		fb_field f;
+
+		f.slot = slot;
+		f.size = sizeof(T);
+		f.child = NULL;
+		memcpy(f.value, &v, sizeof(T));
+		fields.push_back(f);
+
+		return this;
+	}
+
+	fb_node *offset(int slot, fb_node *node)
+	{
+		fb_field f;
+
+		f.slot = slot;
+		f.size = 4;
+		f.child = node;
+		fields.push_back(f);
+
+		return this;
+	}
+};
+
+// owns every node of one message so the tree is freed in one go
+class fb_builder
+{
+	public:
+		~fb_builder()
+		{
+			for(size_t i=0;i<_nodes.size();++i)
+				delete _nodes[i];
+		}
+
+		fb_node *table() { return add(new fb_node(fb_node::fb_table)); }
+
+		fb_node *string(const std::string &s)
+		{
+			fb_node *n = add(new fb_node(fb_node::fb_string));
+			n->bytes = s;
+			return n;
+		}
+
+		fb_node *structs(const void *data, size_t size, size_t count, size_t align)
+		{
+			fb_node *n = add(new fb_node(fb_node::fb_structs));
+			n->bytes.assign((const char*)data, size*count);
+			n->count = count;
+			n->struct_align = align;
+			return n;
+		}
+
+		fb_node *tables() { return add(new fb_node(fb_node::fb_tables)); }
+
+		// lays out the tree under root into out, which is cleared first
+		void finish(fb_node *root, std::vector<unsigned char> &out)
+		{
+			out.assign(4, 0);
+			put_u32(out, 0, (unsigned int)(write(root, out)));
+		}
+
+	private:
+		std::vector<fb_node*> _nodes;
+
+		fb_node *add(fb_node *n) { _nodes.push_back(n); return n; }
+
+		static size_t align(size_t pos, size_t a) { return (pos + a - 1) / a * a; }
+
+		static void put_u32(std::vector<unsigned char> &out, size_t pos, unsigned int v) { memcpy(&out[pos], &v, 4); }
+
+		// returns where the node starts, a table's children are written
+		// after it and the offsets to them filled in once they are placed
+		size_t write(fb_node *n, std::vector<unsigned char> &out)
+		{
+			size_t start, pos, i;
+
+			switch(n->kind)
+			{
+				case fb_node::fb_string:
+				{
+					start = align(out.size(), 4);
+					out.resize(start + 4 + n->bytes.size() + 1, 0);
+					put_u32(out, start, (unsigned int)n->bytes.size());
+					memcpy(&out[start+4], n->bytes.data(), n->bytes.size());
+					return start;
+				}
+				case fb_node::fb_structs:
+				{
+					start = align(out.size() + 4, n->struct_align < 4 ? 4 : n->struct_align) - 4;
+					out.resize(start + 4 + n->bytes.size(), 0);
+					put_u32(out, start, (unsigned int)n->count);
+					if(n->bytes.size()) memcpy(&out[start+4], n->bytes.data(), n->bytes.size());
+					return start;
+				}
+				case fb_node::fb_tables:
+				{
+					start = align(out.size(), 4);
+					out.resize(start + 4 + 4*n->items.size(), 0);
+					put_u32(out, start, (unsigned int)n->items.size());
+
+					for(i=0;i<n->items.size();++i)
+					{
+						pos = start + 4 + 4*i;
+						put_u32(out, pos, (unsigned int)(write(n->items[i], out) - pos));
+					}
+
+					return start;
+				}
+				default:
+					break;
+			}
+
+			// vtable, then the table with its widest fields first so
+			// each lands on its own alignment
+			std::vector<fb_node::fb_field> fields = n->fields;
+			std::vector<size_t> at(fields.size());
+			int slots = 0;
+			size_t vtable, table;
+
+			std::stable_sort(fields.begin(), fields.end(),
+				[](const fb_node::fb_field &a, const fb_node::fb_field &b){ return a.size > b.size; });
+
+			for(i=0;i<fields.size();++i)
+				if(fields[i].slot + 1 > slots) slots = fields[i].slot + 1;
+
+			vtable = align(out.size(), 2);
+			table = align(vtable + 4 + 2*slots, 4);
+			pos = table + 4;
+
+			for(i=0;i<fields.size();++i)
+			{
+				pos = align(pos, fields[i].size);
+				at[i] = pos;
+				pos += fields[i].size;
+			}
+
+			out.resize(pos, 0);
+
+			unsigned short vt[2] = { (unsigned short)(4 + 2*slots), (unsigned short)(pos - table) };
+			int soffset = (int)(table - vtable);
+
+			memcpy(&out[vtable], vt, 4);
+			memcpy(&out[table], &soffset, 4);
+
+			for(i=0;i<fields.size();++i)
+			{
+				unsigned short field_offset = (unsigned short)(at[i] - table);
+
+				memcpy(&out[vtable + 4 + 2*fields[i].slot], &field_offset, 2);
+
+				if(!fields[i].child)
+					memcpy(&out[at[i]], fields[i].value, fields[i].size);
+			}
+
+			for(i=0;i<fields.size();++i)
+				if(fields[i].child)
+					put_u32(out, at[i], (unsigned int)(write(fields[i].child, out) - at[i]));
+
+			return table;
+		}
+};
+
+// Message.fbs, Schema.fbs and File.fbs values used below
+static const short arrow_metadata_v5 = 4;
+static const unsigned char arrow_header_schema = 1;
+static const unsigned char arrow_header_record_batch = 3;
+static const unsigned char arrow_type_int = 2;
+static const unsigned char arrow_type_float = 3;
+static const unsigned char arrow_type_binary = 4;
+static const unsigned char arrow_type_utf8 = 5;
+static const unsigned char arrow_type_date = 8;
+static const unsigned char arrow_type_time = 9;
+static const unsigned char arrow_type_timestamp = 10;
+
+static const char arrow_magic[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+
+// days from 1970-01-01 to a proleptic Gregorian date
+static long long days_from_civil(long long y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	long long era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned)(y - era * 400);
+	unsigned doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+
+	return era * 146097 + (long long)doe - 719468;
+}
+
+// appends text as UTF-8, narrow text is taken to be UTF-8 already
+static void append_utf8(std::string &out, const TCHAR *text, size_t len)
+{
+#if defined(UNICODE) || defined(_UNICODE_)
+	for(size_t i=0;i<len;++i)
+	{
+		unsigned long c = (unsigned long)text[i];
+
+		// UTF-16 surrogate pairs where wchar_t is 16 bits
+		if(sizeof(TCHAR) == 2 && c >= 0xD800 && c < 0xDC00 && i+1 < len)
+		{
+			unsigned long lo = (unsigned long)text[i+1];
+
+			if(lo >= 0xDC00 && lo < 0xE000)
+			{
+				c = 0x10000 + ((c - 0xD800) << 10) + (lo - 0xDC00);
+				++i;
+			}
+		}
+
+		if(c < 0x80)
+			out += (char)c;
+		else if(c < 0x800)
+		{
+			out += (char)(0xC0 | (c >> 6));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else if(c < 0x10000)
+		{
+			out += (char)(0xE0 | (c >> 12));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+		else
+		{
+			out += (char)(0xF0 | (c >> 18));
+			out += (char)(0x80 | ((c >> 12) & 0x3F));
+			out += (char)(0x80 | ((c >> 6) & 0x3F));
+			out += (char)(0x80 | (c & 0x3F));
+		}
+	}
+#else
+	out.append(text, len);
+#endif
+}
+
+// builds the Schema table, written once as a message and again in the footer
+static fb_node *schema_table(fb_builder &b, const std::vector<std::string> &names, const std::vector<unsigned char> &types)
+{
+	fb_node *fields = b.tables();
+
+	for(size_t i=0;i<names.size();++i)
+	{
+		fb_node *type = b.table();
+
+		switch(types[i])
+		{
+			case arrow_type_int: type->scalar<int>(0, 64)->scalar<unsigned char>(1, 1); break;
+			case arrow_type_float: type->scalar<short>(0, 2); break;
+			case arrow_type_date: type->scalar<short>(0, 0); break;
+			case arrow_type_time: type->scalar<short>(0, 0)->scalar<int>(1, 32); break;
+			case arrow_type_timestamp: type->scalar<short>(0, 2); break;
+		}
+
+		fb_node *f = b.table();
+		f->offset(0, b.string(names[i]));
+		f->scalar<unsigned char>(1, 1);
+		f->scalar<unsigned char>(2, types[i]);
+		f->offset(3, type);
+		f->offset(5, b.tables());
+
+		fields->items.push_back(f);
+	}
+
+	return b.table()->scalar<short>(0, 0)->offset(1, fields);
+}
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+arrow_writer::arrow_writer(std::ostream &out, bool stream)
+	: _out(out)
+{
+	_stream = stream;
+	_open = false;
+	_pos = 0;
+	_rows = 0;
+}
+
+bool arrow_writer::begin(const result_schema &schema)
+{
+	std::vector<std::string> names;
+	std::vector<unsigned char> types;
+	size_t col;
+
+	if(_open)
+	{
+		_err = _T("Failed to begin Arrow output, it has already begun");
+		return false;
+	}
+
+	_fields.clear();
+	_blocks.clear();
+	_pos = 0;
+	_rows = 0;
+
+	for(col=1;col<=schema.columns();++col)
+	{
+		const column_info &c = schema.column(col);
+		field f;
+
+		append_utf8(f.name, c.name.data(), c.name.size());
+
+		switch(c.c_type)
+		{
+			case SQL_C_SBIGINT: f.type = arrow_type_int; break;
+			case SQL_C_DOUBLE: f.type = arrow_type_float; break;
+			case SQL_C_TYPE_DATE: f.type = arrow_type_date; break;
+			case SQL_C_TYPE_TIME: f.type = arrow_type_time; break;
+			case SQL_C_TYPE_TIMESTAMP: f.type = arrow_type_timestamp; break;
+			case SQL_C_BINARY: f.type = arrow_type_binary; break;
+			default: f.type = arrow_type_utf8; break;
+		}
+
+		_fields.push_back(f);
+		names.push_back(f.name);
+		types.push_back(f.type);
+	}
+
+	fb_builder b;
+	fb_node *message = b.table();
+
+	message->scalar<short>(0, arrow_metadata_v5);
+	message->scalar<unsigned char>(1, arrow_header_schema);
+	message->offset(2, schema_table(b, names, types));
+	message->scalar<long long>(3, 0);
+
+	b.finish(message, _meta);
+
+	if(!_stream && !write_bytes(arrow_magic, sizeof(arrow_magic))) return false;
+	if(!write_message(_meta, NULL, 0)) return false;
+
+	_open = true;
+
+	return true;
+}
+
+// the body is every column's buffers back to back, each padded to 8
+bool arrow_writer::write(const result_set &rs)
+{
+	std::vector<long long> nodes;
+	size_t col, rows = rs.rows();
+	block blk;
+
+	if(!_open)
+	{
+		_err = _T("Failed to write Arrow batch, begin() hasn't been called");
+		return false;
+	}
+
+	if(rs.columns() != _fields.size())
+	{
+		_err = _T("Failed to write Arrow batch, the result set doesn't match the schema");
+		return false;
+	}
+
+	_body.clear();
+	_buffers.clear();
+	_null_counts.clear();
+
+	for(col=1;col<=rs.columns();++col)
+		encode_column(rs.column(col), _fields[col-1], rows);
+
+	for(col=0;col<_fields.size();++col)
+	{
+		nodes.push_back((long long)rows);
+		nodes.push_back(_null_counts[col]);
+	}
+
+	fb_builder b;
+	fb_node *batch = b.table();
+
+	batch->scalar<long long>(0, (long long)rows);
+	batch->offset(1, b.structs(nodes.data(), 16, _fields.size(), 8));
+	batch->offset(2, b.structs(_buffers.data(), 16, _buffers.size() / 2, 8));
+
+	fb_node *message = b.table();
+
+	message->scalar<short>(0, arrow_metadata_v5);
+	message->scalar<unsigned char>(1, arrow_header_record_batch);
+	message->offset(2, batch);
+	message->scalar<long long>(3, (long long)_body.size());
+
+	b.finish(message, _meta);
+
+	blk.offset = _pos;
+	blk.body_length = (long long)_body.size();
+
+	if(!write_message(_meta, _body.data(), _body.size())) return false;
+
+	blk.meta_length = (int)(_pos - blk.offset - blk.body_length);
+	_blocks.push_back(blk);
+	_rows += rows;
+
+	return true;
+}
+
+// the footer repeats the schema and lists where every batch starts
+bool arrow_writer::end()
+{
+	static const unsigned int eos[2] = { 0xFFFFFFFF, 0 };
+	std::vector<std::string> names;
+	std::vector<unsigned char> types;
+	std::vector<unsigned char> footer;
+	std::vector<long long> blocks;
+	size_t i;
+	int len;
+
+	if(!_open)
+	{
+		_err = _T("Failed to end Arrow output, begin() hasn't been called");
+		return false;
+	}
+
+	_open = false;
+
+	if(!write_bytes(eos, sizeof(eos))) return false;
+
+	if(!_stream)
+	{
+		for(i=0;i<_fields.size();++i)
+		{
+			names.push_back(_fields[i].name);
+			types.push_back(_fields[i].type);
+		}
+
+		// Block is { offset: long, metaDataLength: int, pad, bodyLength: long }
+		for(i=0;i<_blocks.size();++i)
+		{
+			blocks.push_back(_blocks[i].offset);
+			blocks.push_back((long long)(unsigned int)_blocks[i].meta_length);
+			blocks.push_back(_blocks[i].body_length);
+		}
+
+		fb_builder b;
+		fb_node *f = b.table();
+
+		f->scalar<short>(0, arrow_metadata_v5);
+		f->offset(1, schema_table(b, names, types));
+		f->offset(2, b.structs(NULL, 24, 0, 8));
+		f->offset(3, b.structs(blocks.data(), 24, _blocks.size(), 8));
+
+		b.finish(f, footer);
+		len = (int)footer.size();
+
+		if(!write_bytes(footer.data(), footer.size()) || !write_bytes(&len, 4) ||
+		   !write_bytes(arrow_magic, 6))
+			return false;
+	}
+
+	_out.flush();
+
+	if(!_out)
+	{
+		_err = _T("Failed to end Arrow output, the stream could not be flushed");
+		return false;
+	}
+
+	return true;
+}
+
+bool arrow_writer::is_open()
+{
+	return _open;
+}
+
+unsigned long long arrow_writer::rows()
+{
+	return _rows;
+}
+
+unsigned long arrow_writer::batches()
+{
+	return (unsigned long)_blocks.size();
+}
+
+TSTR arrow_writer::last_error()
+{
+	return _err;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// fixed width values are stored back to back without the NULLs, which
+// take no bytes, so they are spread out to one slot per row, text and
+// binary values are already contiguous and only the offsets change
+void arrow_writer::encode_column(const result_column &c, const field &f, size_t rows)
+{
+	size_t bitmap = (rows + 7) / 8, row, i;
+	long long nulls = 0;
+	unsigned char *valid;
+
+	valid = add_buffer(bitmap);
+	memset(valid, 0, bitmap);
+
+	for(row=0;row<rows;++row)
+	{
+		if(c.is_null(row)) ++nulls;
+		else valid[row/8] |= (unsigned char)(1 << (row%8));
+	}
+
+	_null_counts.push_back(nulls);
+
+	// all valid, the bitmap can be left out altogether
+	if(!nulls)
+	{
+		_body.resize(_buffers[_buffers.size()-2]);
+		_buffers.back() = 0;
+	}
+
+	switch(f.type)
+	{
+		case arrow_type_int:
+		case arrow_type_float:
+		case arrow_type_timestamp:
+		{
+			long long *values = (long long*)add_buffer(rows*8);
+
+			for(row=0;row<rows;++row)
+			{
+				values[row] = 0;
+
+				if(c.is_null(row)) continue;
+
+				if(f.type != arrow_type_timestamp)
+				{
+					memcpy(&values[row], c.data(row), 8);
+					continue;
+				}
+
+				SQL_TIMESTAMP_STRUCT ts;
+				memcpy(&ts, c.data(row), sizeof(ts));
+				values[row] = ((days_from_civil(ts.year, ts.month, ts.day) * 86400 +
+								ts.hour * 3600 + ts.minute * 60 + ts.second) * 1000000) + ts.fraction / 1000;
+			}
+			break;
+		}
+		case arrow_type_date:
+		case arrow_type_time:
+		{
+			int *values = (int*)add_buffer(rows*4);
+
+			for(row=0;row<rows;++row)
+			{
+				values[row] = 0;
+
+				if(c.is_null(row)) continue;
+
+				if(f.type == arrow_type_date)
+				{
+					SQL_DATE_STRUCT d;
+					memcpy(&d, c.data(row), sizeof(d));
+					values[row] = (int)days_from_civil(d.year, d.month, d.day);
+				}
+				else
+				{
+					SQL_TIME_STRUCT t;
+					memcpy(&t, c.data(row), sizeof(t));
+					values[row] = t.hour * 3600 + t.minute * 60 + t.second;
+				}
+			}
+			break;
+		}
+		default:
+		{
+			int *offsets = (int*)add_buffer((rows+1)*4);
+			size_t offsets_at = (unsigned char*)offsets - _body.data();
+			const unsigned char *start = rows ? c.data(0) : NULL;
+			size_t bytes = rows ? (c.data(rows-1) - start) + c.length(rows-1) : 0;
+
+			// narrow text and binary go across as they are
+			if(f.type == arrow_type_binary || sizeof(TCHAR) == 1)
+			{
+				for(row=0;row<rows;++row)
+					offsets[row] = (int)(c.data(row) - start);
+				offsets[rows] = (int)bytes;
+
+				if(bytes) memcpy(add_buffer(bytes), start, bytes);
+				else add_buffer(0);
+				break;
+			}
+
+			std::string utf8;
+
+			for(row=0;row<rows;++row)
+			{
+				((int*)&_body[offsets_at])[row] = (int)utf8.size();
+				append_utf8(utf8, (const TCHAR*)c.data(row), c.length(row)/sizeof(TCHAR));
+			}
+			((int*)&_body[offsets_at])[rows] = (int)utf8.size();
+
+			i = utf8.size();
+			if(i) memcpy(add_buffer(i), utf8.data(), i);
+			else add_buffer(0);
+			break;
+		}
+	}
+}
+
+unsigned char *arrow_writer::add_buffer(size_t len)
+{
+	size_t at = _body.size();
+
+	_body.resize(at + (len + 7) / 8 * 8, 0);
+	_buffers.push_back((long long)at);
+	_buffers.push_back((long long)len);
+
+	return &_body[at];
+}
+
+// continuation marker, metadata length padded so the body starts on 8
+bool arrow_writer::write_message(const std::vector<unsigned char> &meta, const unsigned char *body, size_t body_len)
+{
+	static const unsigned char pad[8] = { 0 };
+	unsigned int marker = 0xFFFFFFFF;
+	int len = (int)((meta.size() + 7) / 8 * 8);
+
+	return write_bytes(&marker, 4) && write_bytes(&len, 4) && write_bytes(meta.data(), meta.size()) &&
+		   write_bytes(pad, len - meta.size()) && (!body_len || write_bytes(body, body_len));
+}
+
+bool arrow_writer::write_bytes(const void *data, size_t len)
+{
+	if(len) _out.write((const char*)data, len);
+
+	if(!_out)
+	{
+		_err = _T("Failed to write Arrow output, the stream is in a failed state");
+		_open = false;
+		return false;
+	}
+
+	_pos += (long long)len;
+
+	return true;
+}
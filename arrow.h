@@ -0,0 +1,106 @@
+/*
+  Name: arrow.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Writes result sets out in the Arrow IPC file or stream
+               format a record batch at a time, so a result of any size
+               can be exported with only one batch held in memory
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef ARROW_H
+#define ARROW_H
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "result_set.h"
+
+// rows and value bytes statement::export_arrow() gathers per batch
+#if !defined(ODBC_ARROW_BATCH_ROWS)
+    #define ODBC_ARROW_BATCH_ROWS 65536
+#endif
+
+#if !defined(ODBC_ARROW_BATCH_BYTES)
+    #define ODBC_ARROW_BATCH_BYTES (64*1024*1024)
+#endif
+
+// Columns map to Arrow types by the C type their values are stored as,
+// SQL_C_SBIGINT is int64, SQL_C_DOUBLE double, SQL_C_TYPE_DATE date32,
+// SQL_C_TYPE_TIME time32[s], SQL_C_TYPE_TIMESTAMP timestamp[us],
+// SQL_C_BINARY binary and text utf8, every field is nullable
+// Text and binary offsets are 32 bit, so a batch holds under 2GB of any
+// one column
+class arrow_writer
+{
+	public:
+		// writes to out, which must be binary, stream writes the IPC
+		// stream format instead of the file format with its footer
+		arrow_writer(std::ostream &out, bool stream = false);
+
+		arrow_writer(const arrow_writer&) = delete;
+		arrow_writer &operator=(const arrow_writer&) = delete;
+
+		// writes the schema, every batch must be laid out the same
+		bool begin(const result_schema &schema);
+		// writes the rows of rs as one record batch
+		bool write(const result_set &rs);
+		// writes the end of stream marker and for files the footer,
+		// the output isn't readable until this has been called
+		bool end();
+
+		// returns whether begin() has been called and end() hasn't
+		bool is_open();
+		// returns the rows and record batches written so far
+		unsigned long long rows();
+		unsigned long batches();
+		// returns the reason the last call failed
+		TSTR last_error();
+
+	private:
+		// a field of the schema, type is the Arrow type union tag
+		struct field
+		{
+			std::string name;
+			unsigned char type;
+		};
+
+		// a record batch's place in the file for the footer
+		struct block
+		{
+			long long offset;
+			int meta_length;
+			long long body_length;
+		};
+
+		std::ostream &_out;
+		bool _stream;
+		bool _open;
+		TSTR _err;
+
+		std::vector<field> _fields;
+		std::vector<block> _blocks;
+		// bytes written so far, batches are located by it in the footer
+		long long _pos;
+		unsigned long long _rows;
+
+		// the batch being encoded, kept to be reused by the next one
+		std::vector<unsigned char> _meta;
+		std::vector<unsigned char> _body;
+		// offset and length of every buffer, null count of every column
+		std::vector<long long> _buffers;
+		std::vector<long long> _null_counts;
+
+		// appends one column's validity, offset and value buffers
+		void encode_column(const result_column &c, const field &f, size_t rows);
+		// appends a buffer of len bytes padded to 8 and records it
+		unsigned char *add_buffer(size_t len);
+		// writes an encapsulated message, metadata then body
+		bool write_message(const std::vector<unsigned char> &meta, const unsigned char *body, size_t body_len);
+		bool write_bytes(const void *data, size_t len);
+};
+
+
+#endif
@@ -0,0 +1,160 @@
+#include "headers\odbc.h"
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+async_executor::async_executor(size_t workers)
+{
+	size_t i;
+
+	_running = 0;
+	_interval = std::chrono::microseconds(200);
+	_stop = false;
+
+	_poller = std::thread(&async_executor::poll_loop, this);
+
+	for(i=0;i<(workers ? workers : 1);++i)
+		_workers.push_back(std::thread(&async_executor::work_loop, this));
+}
+
+async_executor::~async_executor()
+{
+	std::vector<std::thread>::iterator itr;
+
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_stop = true;
+	}
+
+	_poll_wake.notify_all();
+	_task_wake.notify_all();
+
+	_poller.join();
+
+	for(itr=_workers.begin();itr!=_workers.end();++itr)
+		itr->join();
+}
+
+async_executor &async_executor::shared()
+{
+	static async_executor executor(ODBC_ASYNC_WORKERS);
+
+	return executor;
+}
+
+void async_executor::poll(std::function<SQLRETURN()> call, std::function<void(SQLRETURN)> done)
+{
+	pending p;
+	p.call = call;
+	p.done = done;
+
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_polling.push_back(p);
+	}
+
+	_poll_wake.notify_one();
+}
+
+void async_executor::run(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_tasks.push_back(task);
+	}
+
+	_task_wake.notify_one();
+}
+
+void async_executor::set_poll_interval(std::chrono::microseconds interval)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	_interval = interval;
+}
+
+size_t async_executor::polling()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _polling.size();
+}
+
+size_t async_executor::tasks()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _tasks.size() + _running;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// takes every call in flight out from under the lock, gives each one
+// another go and puts back the ones still executing, then sleeps for
+// the interval unless a new call arrives first
+void async_executor::poll_loop()
+{
+	std::list<pending> batch;
+	std::list<pending>::iterator itr;
+	SQLRETURN rc;
+	std::unique_lock<std::mutex> lock(_lock);
+
+	for(;;)
+	{
+		_poll_wake.wait(lock, [this]{ return _stop || !_polling.empty(); });
+
+		if(_polling.empty()) return;
+
+		batch.splice(batch.end(), _polling);
+		lock.unlock();
+
+		for(itr=batch.begin();itr!=batch.end();)
+		{
+			rc = itr->call();
+
+			if(rc == SQL_STILL_EXECUTING)
+			{
+				++itr;
+				continue;
+			}
+
+			itr->done(rc);
+			itr = batch.erase(itr);
+		}
+
+		lock.lock();
+
+		if(!batch.empty())
+		{
+			_polling.splice(_polling.begin(), batch);
+			_poll_wake.wait_for(lock, _interval);
+		}
+	}
+}
+
+void async_executor::work_loop()
+{
+	std::function<void()> task;
+	std::unique_lock<std::mutex> lock(_lock);
+
+	for(;;)
+	{
+		_task_wake.wait(lock, [this]{ return _stop || !_tasks.empty(); });
+
+		if(_tasks.empty()) return;
+
+		task = std::move(_tasks.front());
+		_tasks.pop_front();
+		++_running;
+
+		lock.unlock();
+		task();
+		task = nullptr;
+		lock.lock();
+
+		--_running;
+	}
+}
@@ -0,0 +1,88 @@
+/*
+  Name: async.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Executor behind the statement *_async() calls
+               One poller thread drives every statement running in ODBC
+               async mode, re-issuing each call until it stops returning
+               SQL_STILL_EXECUTING, and a small worker pool runs the
+               blocking calls of drivers without async support
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// default number of worker threads for drivers without async support
+#if !defined(ODBC_ASYNC_WORKERS)
+    #define ODBC_ASYNC_WORKERS 4
+#endif
+
+class async_executor
+{
+	public:
+		// starts the poller and workers threads
+		async_executor(size_t workers);
+		// finishes everything in flight and queued, then joins
+		~async_executor();
+
+		async_executor(const async_executor&) = delete;
+		async_executor &operator=(const async_executor&) = delete;
+
+		// executor used by statements, started on first use
+		static async_executor &shared();
+
+		// calls call on the poller thread until it returns anything but
+		// SQL_STILL_EXECUTING and then hands that return code to done,
+		// call must re-issue the same ODBC function with the same arguments
+		void poll(std::function<SQLRETURN()> call, std::function<void(SQLRETURN)> done);
+		// runs task on a worker thread
+		void run(std::function<void()> task);
+
+		// how long the poller sleeps between passes over the calls in flight
+		void set_poll_interval(std::chrono::microseconds interval);
+
+		// returns the number of calls being polled and tasks queued or running
+		size_t polling();
+		size_t tasks();
+
+	private:
+		// an async call in flight
+		struct pending
+		{
+			std::function<SQLRETURN()> call;
+			std::function<void(SQLRETURN)> done;
+		};
+
+		std::mutex _lock;
+		std::condition_variable _poll_wake;
+		std::condition_variable _task_wake;
+
+		std::list<pending> _polling;
+		std::deque<std::function<void()> > _tasks;
+		size_t _running;
+
+		std::chrono::microseconds _interval;
+		bool _stop;
+
+		std::thread _poller;
+		std::vector<std::thread> _workers;
+
+		void poll_loop();
+		void work_loop();
+};
+
+
+#endif
@@ -0,0 +1,169 @@
+/*
+  Name: column_lookup.cpp
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Benchmarks row construction and field name lookup with the
+               linear unordered_row search against the shared schema index
+               at 10, 100 and 500 columns
+*/
+
+// Build alongside the ODBC headers, no database is needed, spill.cpp
+// backs the result set arena past its memory budget:
+// cl /O2 /EHsc /std:c++17 column_lookup.cpp ..\spill.cpp
+
+#include <windows.h>
+#include <tchar.h>
+#include <sql.h>
+#include <sqlext.h>
+#include <sqlucode.h>
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+#include "../result_set.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static const size_t ROWS = 2000;
+
+// nanoseconds per operation since start
+static double ns_per_op(bench_clock::time_point start, size_t ops)
+{
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / ops;
+}
+
+static void run(size_t columns)
+{
+    std::shared_ptr<result_schema> schema(new result_schema());
+    std::vector<TSTR> names;
+    result_set rs;
+    size_t col, i;
+    size_t found = 0;
+
+    for(col=1;col<=columns;++col)
+    {
+        std::basic_ostringstream<TCHAR> name;
+        name << _T("column_") << col;
+
+        column_info c;
+        c.name = name.str();
+        c.sql_type = SQL_VARCHAR;
+        c.c_type = SQL_C_TCHAR;
+        c.size = 16;
+        c.decimals = 0;
+        c.nullable = SQL_NULLABLE;
+        c.lob = false;
+
+        schema->add_column(c);
+        names.push_back(c.name);
+    }
+
+    rs.reset(schema);
+
+    for(i=0;i<ROWS;++i)
+    {
+        for(col=1;col<=columns;++col)
+            rs.append(col, _T("value"), 5*sizeof(TCHAR));
+        rs.end_row();
+    }
+
+    // row construction, linear add_field against the shared index
+    bench_clock::time_point start = bench_clock::now();
+    for(i=1;i<=ROWS;++i)
+    {
+        row_view v = rs.row(i);
+        unordered_row r(v.row_id());
+
+        for(col=1;col<=columns;++col)
+            r.add_field(field(v.name(col), v.value(col)));
+
+        found += r.num_fields();
+    }
+    double build_linear = ns_per_op(start, ROWS*columns);
+
+    start = bench_clock::now();
+    for(i=1;i<=ROWS;++i)
+        found += rs.row(i).to_row().num_fields();
+    double build_indexed = ns_per_op(start, ROWS*columns);
+
+    // name lookups on a built row
+    unordered_row linear_row(1);
+    unordered_row indexed_row = rs.row(1).to_row();
+    for(col=1;col<=columns;++col)
+        linear_row.add_field(field(names[col-1], _T("value")));
+
+    start = bench_clock::now();
+    for(i=0;i<ROWS;++i)
+        for(col=0;col<columns;++col)
+            found += linear_row.get_field(names[col]).length();
+    double lookup_linear = ns_per_op(start, ROWS*columns);
+
+    start = bench_clock::now();
+    for(i=0;i<ROWS;++i)
+        for(col=0;col<columns;++col)
+            found += indexed_row.get_field(names[col]).length();
+    double lookup_indexed = ns_per_op(start, ROWS*columns);
+
+    row_view v = rs.row(1);
+    start = bench_clock::now();
+    for(i=0;i<ROWS;++i)
+        for(col=0;col<columns;++col)
+            found += v.index(names[col]);
+    double lookup_schema = ns_per_op(start, ROWS*columns);
+
+    printf("%4u columns | build/field linear %8.1f ns  indexed %8.1f ns"
+           " | lookup linear %8.1f ns  indexed %8.1f ns  schema %8.1f ns | %u\n",
+           (unsigned)columns, build_linear, build_indexed,
+           lookup_linear, lookup_indexed, lookup_schema, (unsigned)(found & 1));
+}
+
+// fields added against the shared index in the reverse of its order must
+// still be kept apart and found by name, returns false if they aren't
+static bool check_out_of_order(size_t columns)
+{
+    std::shared_ptr<FIELDINDEX> index(new FIELDINDEX());
+    std::vector<TSTR> names;
+    unordered_row r(1, index);
+    size_t col;
+
+    for(col=0;col<columns;++col)
+    {
+        std::basic_ostringstream<TCHAR> name;
+        name << _T("column_") << col;
+
+        names.push_back(name.str());
+        index->insert(std::make_pair(name.str(), col));
+    }
+
+    for(col=columns;col>0;--col)
+        r.add_field(field(names[col-1], names[col-1]));
+
+    if(r.num_fields() != columns)
+    {
+        printf("out of order add_field kept %u of %u fields\n", (unsigned)r.num_fields(), (unsigned)columns);
+        return false;
+    }
+
+    for(col=0;col<columns;++col)
+    {
+        if(r.get_field(names[col]).value() != names[col])
+        {
+            printf("out of order lookup of column %u returned the wrong field\n", (unsigned)col);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main()
+{
+    if(!check_out_of_order(10) || !check_out_of_order(100) || !check_out_of_order(500))
+        return 1;
+
+    run(10);
+    run(100);
+    run(500);
+
+    return 0;
+}
@@ -0,0 +1,678 @@
+/*
+  Name: fake_driver.cpp
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: In-process stand-in for an ODBC driver used by the benchmarks
+               Implements the ODBC entry points the wrapper calls and makes
+               up every result set from its SQL text, so fetch paths can be
+               measured without a database server
+*/
+
+// Linked in place of the driver manager, the benchmark talks to it
+// directly so the numbers leave out unixODBC's own dispatch overhead.
+// Narrow characters only.
+//
+// Queries describe the result set they return:
+//     FAKE rows=100000 cols=8 types=isdt width=32 nulls=7 latency=50
+// types cycle over the columns, i BIGINT, s VARCHAR(width), d DOUBLE,
+// t TIMESTAMP, b VARBINARY(width), l LONGVARCHAR of lob=n characters,
+// column 1 is named id and holds the row number, every nulls-th value
+// of the other columns is NULL and latency adds that many microseconds
+// to every prepare, execute and fetch
+// Statements starting with INSERT, UPDATE or DELETE return no rows and
+// count every parameter set as one affected row.
+// "SELECT MIN(c), MAX(c) FROM (FAKE rows=n ...)" returns 0 and n-1, and
+// "... WHERE c BETWEEN lo AND hi" / "... IS NULL" narrow the rows the
+// same way a real partitioned scan would.
+
+#if defined(_WIN32)
+    #include <windows.h>
+#endif
+#include <sql.h>
+#include <sqlext.h>
+#include <sqlucode.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+#include <thread>
+#include <atomic>
+
+struct fake_env { int version; };
+struct fake_dbc { bool connected; bool dead; };
+
+struct fake_binding
+{
+	SQLSMALLINT c_type;
+	SQLPOINTER ptr;
+	SQLLEN len;
+	SQLLEN *ind;
+};
+
+struct fake_param
+{
+	SQLSMALLINT c_type;
+	SQLPOINTER ptr;
+	SQLLEN len;
+	SQLLEN *ind;
+};
+
+struct fake_stmt
+{
+	fake_dbc *dbc;
+	std::string sql;
+	bool prepared;
+	bool executed;
+	bool is_query;
+	long long rows;
+	int cols;
+	std::string types;
+	int width;
+	int nulls;
+	int lob_size;
+	int latency;
+	// first generated row id, and whether this is a MIN/MAX query
+	long long partition_lo;
+	bool minmax;
+	long long max_id;
+	// reused for every cell value
+	std::string scratch;
+	std::string hex;
+	// last long value generated and its cell
+	std::string lob_value;
+	long long lob_row;
+	int lob_col;
+	long long pos;          // next row to fetch
+	long long cur;          // first row of current block
+	long long affected;
+	std::map<int, fake_binding> bound;
+	std::map<int, fake_param> params;
+	SQLULEN array_size;
+	SQLULEN bind_type;
+	SQLULEN *bind_offset;
+	SQLUSMALLINT *row_status;
+	SQLULEN *rows_fetched;
+	SQLULEN paramset_size;
+	SQLULEN param_bind_type;
+	SQLUSMALLINT *param_status;
+	SQLULEN *params_processed;
+	int getdata_col;
+	size_t getdata_off;
+	bool async;
+	int async_pending;
+	std::chrono::steady_clock::time_point async_deadline;
+};
+
+// number of ODBC calls made, the async mode SQLGetInfo reports and
+// parameter sets consumed by INSERT/UPDATE/DELETE
+std::atomic<long long> fake_driver_calls(0);
+int fake_async_mode = SQL_AM_STATEMENT;
+std::atomic<long long> fake_inserted(0);
+
+static long long opt(const std::string &sql, const char *key, long long def)
+{
+	std::string k = std::string(key) + "=";
+	size_t p = sql.find(k);
+	if(p == std::string::npos) return def;
+	return atoll(sql.c_str() + p + k.size());
+}
+
+static std::string opts(const std::string &sql, const char *key, const char *def)
+{
+	std::string k = std::string(key) + "=";
+	size_t p = sql.find(k);
+	if(p == std::string::npos) return def;
+	size_t e = sql.find_first_of(" ;)", p);
+	return sql.substr(p + k.size(), e == std::string::npos ? std::string::npos : e - p - k.size());
+}
+
+static char col_kind(fake_stmt *s, int col) { return s->types[(col-1) % s->types.size()]; }
+
+static SQLSMALLINT sql_type(char k)
+{
+	switch(k)
+	{
+		case 'i': return SQL_BIGINT;
+		case 'd': return SQL_DOUBLE;
+		case 't': return SQL_TYPE_TIMESTAMP;
+		case 'b': return SQL_VARBINARY;
+		case 'l': return SQL_LONGVARCHAR;
+		default: return SQL_VARCHAR;
+	}
+}
+
+static bool is_null(fake_stmt *s, long long row, int col)
+{
+	return s->nulls && col > 1 && (row + col) % s->nulls == 0;
+}
+
+// returns the textual value of a cell, binary cells are raw bytes, the
+// value lives in the statement's scratch strings so no cell allocates
+// once they have grown to the widest value
+static const std::string &text_value(fake_stmt *s, long long row, int col)
+{
+	std::string &v = s->scratch;
+	char buf[64];
+	long long id = row + s->partition_lo;
+	int n;
+
+	switch(col_kind(s, col))
+	{
+		case 'i':
+			if(s->minmax) n = snprintf(buf, sizeof(buf), "%lld", col == 1 ? 0LL : s->max_id);
+			else n = snprintf(buf, sizeof(buf), "%lld", col == 1 ? id : id * col);
+			v.assign(buf, n);
+			return v;
+		case 'd': n = snprintf(buf, sizeof(buf), "%.15g", id * 0.25 + col); v.assign(buf, n); return v;
+		case 't': n = snprintf(buf, sizeof(buf), "2026-%02d-%02d %02d:%02d:%02d", (int)(id % 12) + 1, (int)(id % 28) + 1, (int)(id % 24), col, (int)(id % 60)); v.assign(buf, n); return v;
+		case 'l':
+			// SQLGetData asks for the same value once per chunk, the row
+			// and column are stamped over a fixed fill so generating the
+			// value costs about as much as a memcpy of it
+			if(s->lob_row != id || s->lob_col != col || (int)s->lob_value.size() != s->lob_size)
+			{
+				if((int)s->lob_value.size() != s->lob_size)
+				{
+					s->lob_value.resize(s->lob_size);
+					for(int i=0;i<s->lob_size;++i) s->lob_value[i] = (char)('a' + i % 26);
+				}
+				n = snprintf(buf, sizeof(buf), "<r%lldc%d>", id, col);
+				memcpy(&s->lob_value[0], buf, n < s->lob_size ? n : s->lob_size);
+				s->lob_row = id;
+				s->lob_col = col;
+			}
+			return s->lob_value;
+		case 'b':
+			v.resize(s->width);
+			for(int i=0;i<s->width;++i) v[i] = (char)((id + i * col) & 0xFF);
+			return v;
+		default:
+			n = snprintf(buf, sizeof(buf), "r%lldc%d", id, col);
+			v.assign(buf, n);
+			while((int)v.size() < s->width) v += (char)('a' + (v.size() % 26));
+			v.resize(s->width);
+			return v;
+	}
+}
+
+// converts a cell to the requested C type, returns bytes written and the full length
+static SQLRETURN convert(fake_stmt *s, long long row, int col, SQLSMALLINT c_type, SQLPOINTER ptr, SQLLEN len, SQLLEN *ind, size_t offset, size_t *consumed)
+{
+	if(is_null(s, row, col)) { if(ind) *ind = SQL_NULL_DATA; else return SQL_ERROR; return SQL_SUCCESS; }
+
+	const std::string *value = &text_value(s, row, col);
+	const std::string &v = *value;
+	char kind = col_kind(s, col);
+	long long id = row + s->partition_lo;
+
+	switch(c_type)
+	{
+		case SQL_C_SBIGINT:
+		{
+			SQLBIGINT i = atoll(v.c_str());
+			memcpy(ptr, &i, sizeof(i)); if(ind) *ind = sizeof(i);
+			return SQL_SUCCESS;
+		}
+		case SQL_C_DOUBLE:
+		{
+			SQLDOUBLE d = atof(v.c_str());
+			memcpy(ptr, &d, sizeof(d)); if(ind) *ind = sizeof(d);
+			return SQL_SUCCESS;
+		}
+		case SQL_C_SLONG: case SQL_C_ULONG: case SQL_C_SSHORT: case SQL_C_USHORT:
+		case SQL_C_STINYINT: case SQL_C_UTINYINT: case SQL_C_UBIGINT: case SQL_C_BIT:
+		{
+			long long i = atoll(v.c_str());
+			size_t n = c_type == SQL_C_SLONG || c_type == SQL_C_ULONG ? 4 :
+					   c_type == SQL_C_SSHORT || c_type == SQL_C_USHORT ? 2 : c_type == SQL_C_UBIGINT ? 8 : 1;
+			if(c_type == SQL_C_BIT) i = i != 0;
+			memcpy(ptr, &i, n); if(ind) *ind = (SQLLEN)n;
+			return SQL_SUCCESS;
+		}
+		case SQL_C_FLOAT:
+		{
+			SQLREAL f = (SQLREAL)atof(v.c_str());
+			memcpy(ptr, &f, sizeof(f)); if(ind) *ind = sizeof(f);
+			return SQL_SUCCESS;
+		}
+		case SQL_C_TYPE_TIMESTAMP:
+		{
+			SQL_TIMESTAMP_STRUCT ts;
+			memset(&ts, 0, sizeof(ts));
+			if(kind == 't')
+			{
+				ts.year = 2026; ts.month = (SQLUSMALLINT)(id % 12 + 1); ts.day = (SQLUSMALLINT)(id % 28 + 1);
+				ts.hour = (SQLUSMALLINT)(id % 24); ts.minute = (SQLUSMALLINT)col; ts.second = (SQLUSMALLINT)(id % 60);
+			}
+			memcpy(ptr, &ts, sizeof(ts)); if(ind) *ind = sizeof(ts);
+			return SQL_SUCCESS;
+		}
+		case SQL_C_BINARY:
+		{
+			size_t rem = v.size() > offset ? v.size() - offset : 0;
+			size_t n = rem < (size_t)len ? rem : (size_t)len;
+			memcpy(ptr, v.data() + offset, n);
+			if(consumed) *consumed = n;
+			if(ind) *ind = (SQLLEN)rem;
+			return rem > (size_t)len ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+		}
+		default:
+		{
+			if(kind == 'b')
+			{
+				static const char *hex = "0123456789ABCDEF";
+				std::string &h = s->hex;
+				h.resize(v.size() * 2);
+				for(size_t i=0;i<v.size();++i) { h[i*2] = hex[(unsigned char)v[i] >> 4]; h[i*2+1] = hex[(unsigned char)v[i] & 15]; }
+				value = &h;
+			}
+			const std::string &t = *value;
+			if(c_type == SQL_C_WCHAR)
+			{
+				size_t rem = t.size() > offset ? t.size() - offset : 0;
+				size_t cap = len / sizeof(SQLWCHAR);
+				size_t n = cap ? (rem < cap - 1 ? rem : cap - 1) : 0;
+				SQLWCHAR *w = (SQLWCHAR*)ptr;
+				for(size_t i=0;i<n;++i) w[i] = (SQLWCHAR)(unsigned char)t[offset+i];
+				if(cap) w[n] = 0;
+				if(consumed) *consumed = n;
+				if(ind) *ind = (SQLLEN)(rem * sizeof(SQLWCHAR));
+				return rem > n ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+			}
+			size_t rem = t.size() > offset ? t.size() - offset : 0;
+			size_t n = len ? (rem < (size_t)len - 1 ? rem : (size_t)len - 1) : 0;
+			memcpy(ptr, t.data() + offset, n);
+			if(len) ((char*)ptr)[n] = 0;
+			if(consumed) *consumed = n;
+			if(ind) *ind = (SQLLEN)rem;
+			return rem > n ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+		}
+	}
+}
+
+static void latency(fake_stmt *s)
+{
+	if(s->latency) std::this_thread::sleep_for(std::chrono::microseconds(s->latency));
+}
+
+extern "C" {
+
+SQLRETURN SQLAllocHandle(SQLSMALLINT type, SQLHANDLE in, SQLHANDLE *out)
+{
+	++fake_driver_calls;
+	if(type == SQL_HANDLE_ENV) { *out = new fake_env(); return SQL_SUCCESS; }
+	if(type == SQL_HANDLE_DBC) { fake_dbc *d = new fake_dbc(); d->connected = false; d->dead = false; *out = d; return SQL_SUCCESS; }
+	if(type == SQL_HANDLE_STMT)
+	{
+		fake_stmt *s = new fake_stmt();
+		s->dbc = (fake_dbc*)in;
+		s->prepared = s->executed = s->is_query = false;
+		s->rows = 0; s->cols = 0; s->width = 16; s->nulls = 0; s->lob_size = 0; s->latency = 0;
+		s->partition_lo = 0; s->minmax = false; s->max_id = 0;
+		s->pos = s->cur = 0; s->affected = 0;
+		s->array_size = 1; s->bind_type = SQL_BIND_BY_COLUMN; s->bind_offset = 0;
+		s->row_status = 0; s->rows_fetched = 0;
+		s->paramset_size = 1; s->param_bind_type = 0; s->param_status = 0; s->params_processed = 0;
+		s->getdata_col = 0; s->getdata_off = 0;
+		s->lob_row = -1; s->lob_col = 0;
+		s->async = false; s->async_pending = 0;
+		*out = s;
+		return SQL_SUCCESS;
+	}
+	return SQL_ERROR;
+}
+
+SQLRETURN SQLAllocStmt(SQLHDBC dbc, SQLHSTMT *out) { return SQLAllocHandle(SQL_HANDLE_STMT, dbc, out); }
+
+SQLRETURN SQLFreeHandle(SQLSMALLINT type, SQLHANDLE h)
+{
+	++fake_driver_calls;
+	if(!h) return SQL_INVALID_HANDLE;
+	if(type == SQL_HANDLE_ENV) delete (fake_env*)h;
+	else if(type == SQL_HANDLE_DBC) delete (fake_dbc*)h;
+	else if(type == SQL_HANDLE_STMT) delete (fake_stmt*)h;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLFreeStmt(SQLHSTMT h, SQLUSMALLINT option)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(!s) return SQL_INVALID_HANDLE;
+	switch(option)
+	{
+		case SQL_DROP: delete s; return SQL_SUCCESS;
+		case SQL_CLOSE: s->executed = false; s->pos = 0; return SQL_SUCCESS;
+		case SQL_UNBIND: s->bound.clear(); return SQL_SUCCESS;
+		case SQL_RESET_PARAMS: s->params.clear(); return SQL_SUCCESS;
+	}
+	return SQL_ERROR;
+}
+
+SQLRETURN SQLCloseCursor(SQLHSTMT h) { return SQLFreeStmt(h, SQL_CLOSE); }
+SQLRETURN SQLCancel(SQLHSTMT) { ++fake_driver_calls; return SQL_SUCCESS; }
+
+SQLRETURN SQLSetEnvAttr(SQLHENV, SQLINTEGER, SQLPOINTER, SQLINTEGER) { ++fake_driver_calls; return SQL_SUCCESS; }
+SQLRETURN SQLGetEnvAttr(SQLHENV, SQLINTEGER, SQLPOINTER, SQLINTEGER, SQLINTEGER*) { ++fake_driver_calls; return SQL_SUCCESS; }
+SQLRETURN SQLDataSources(SQLHENV, SQLUSMALLINT, SQLTCHAR*, SQLSMALLINT, SQLSMALLINT*, SQLTCHAR*, SQLSMALLINT, SQLSMALLINT*) { ++fake_driver_calls; return SQL_NO_DATA; }
+
+SQLRETURN SQLConnect(SQLHDBC h, SQLTCHAR*, SQLSMALLINT, SQLTCHAR*, SQLSMALLINT, SQLTCHAR*, SQLSMALLINT)
+{
+	++fake_driver_calls;
+	((fake_dbc*)h)->connected = true;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLDriverConnect(SQLHDBC h, SQLHWND, SQLTCHAR *in, SQLSMALLINT, SQLTCHAR *out, SQLSMALLINT outlen, SQLSMALLINT *len, SQLUSMALLINT)
+{
+	++fake_driver_calls;
+	((fake_dbc*)h)->connected = true;
+	if(out && outlen) { strncpy((char*)out, (char*)in, outlen - 1); out[outlen-1] = 0; }
+	if(len) *len = (SQLSMALLINT)strlen((char*)in);
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLDisconnect(SQLHDBC h) { ++fake_driver_calls; ((fake_dbc*)h)->connected = false; return SQL_SUCCESS; }
+
+SQLRETURN SQLSetConnectAttr(SQLHDBC, SQLINTEGER, SQLPOINTER, SQLINTEGER) { ++fake_driver_calls; return SQL_SUCCESS; }
+
+SQLRETURN SQLGetConnectAttr(SQLHDBC h, SQLINTEGER attr, SQLPOINTER value, SQLINTEGER, SQLINTEGER*)
+{
+	++fake_driver_calls;
+	if(attr == SQL_ATTR_CONNECTION_DEAD) { *(SQLUINTEGER*)value = ((fake_dbc*)h)->dead ? SQL_CD_TRUE : SQL_CD_FALSE; return SQL_SUCCESS; }
+	return SQL_ERROR;
+}
+
+SQLRETURN SQLGetInfo(SQLHDBC, SQLUSMALLINT type, SQLPOINTER value, SQLSMALLINT, SQLSMALLINT*)
+{
+	++fake_driver_calls;
+	switch(type)
+	{
+		case SQL_ASYNC_MODE: *(SQLUINTEGER*)value = fake_async_mode; return SQL_SUCCESS;
+		case SQL_GETDATA_EXTENSIONS: *(SQLUINTEGER*)value = SQL_GD_ANY_COLUMN | SQL_GD_ANY_ORDER | SQL_GD_BOUND; return SQL_SUCCESS;
+		case SQL_MAX_CONCURRENT_ACTIVITIES: *(SQLUSMALLINT*)value = 0; return SQL_SUCCESS;
+	}
+	return SQL_ERROR;
+}
+
+SQLRETURN SQLGetFunctions(SQLHDBC, SQLUSMALLINT, SQLUSMALLINT *supported) { ++fake_driver_calls; *supported = 1; return SQL_SUCCESS; }
+SQLRETURN SQLEndTran(SQLSMALLINT, SQLHANDLE, SQLSMALLINT) { ++fake_driver_calls; return SQL_SUCCESS; }
+
+SQLRETURN SQLSetStmtAttr(SQLHSTMT h, SQLINTEGER attr, SQLPOINTER value, SQLINTEGER)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	switch(attr)
+	{
+		case SQL_ATTR_ROW_ARRAY_SIZE: s->array_size = (SQLULEN)value; break;
+		case SQL_ATTR_ROW_BIND_TYPE: s->bind_type = (SQLULEN)value; break;
+		case SQL_ATTR_ROW_BIND_OFFSET_PTR: s->bind_offset = (SQLULEN*)value; break;
+		case SQL_ATTR_ROW_STATUS_PTR: s->row_status = (SQLUSMALLINT*)value; break;
+		case SQL_ATTR_ROWS_FETCHED_PTR: s->rows_fetched = (SQLULEN*)value; break;
+		case SQL_ATTR_PARAMSET_SIZE: s->paramset_size = (SQLULEN)value; break;
+		case SQL_ATTR_PARAM_BIND_TYPE: s->param_bind_type = (SQLULEN)value; break;
+		case SQL_ATTR_PARAM_STATUS_PTR: s->param_status = (SQLUSMALLINT*)value; break;
+		case SQL_ATTR_PARAMS_PROCESSED_PTR: s->params_processed = (SQLULEN*)value; break;
+		case SQL_ATTR_ASYNC_ENABLE: if(fake_async_mode == SQL_AM_NONE && (SQLULEN)value == SQL_ASYNC_ENABLE_ON) return SQL_ERROR; s->async = (SQLULEN)value == SQL_ASYNC_ENABLE_ON; break;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLGetStmtAttr(SQLHSTMT h, SQLINTEGER attr, SQLPOINTER value, SQLINTEGER, SQLINTEGER*)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(attr == SQL_ATTR_ROW_ARRAY_SIZE) { *(SQLULEN*)value = s->array_size; return SQL_SUCCESS; }
+	return SQL_ERROR;
+}
+
+static void parse(fake_stmt *s, const std::string &sql)
+{
+	s->sql = sql;
+	s->is_query = sql.compare(0, 6, "INSERT") != 0 && sql.compare(0, 6, "UPDATE") != 0 && sql.compare(0, 6, "DELETE") != 0;
+	s->rows = opt(sql, "rows", 0);
+	s->cols = (int)opt(sql, "cols", 1);
+	s->types = opts(sql, "types", "s");
+	s->width = (int)opt(sql, "width", 16);
+	s->nulls = (int)opt(sql, "nulls", 0);
+	s->lob_size = (int)opt(sql, "lob", 100000);
+	s->latency = (int)opt(sql, "latency", 0);
+	s->partition_lo = 0;
+	s->minmax = false;
+	s->max_id = 0;
+}
+
+static SQLRETURN run(fake_stmt *s)
+{
+	if(s->async)
+	{
+		// async latency is a deadline polled against rather than a sleep
+		if(s->async_pending == 0) { s->async_pending = 1; s->async_deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(s->latency); return SQL_STILL_EXECUTING; }
+		if(std::chrono::steady_clock::now() < s->async_deadline) return SQL_STILL_EXECUTING;
+	}
+	else
+		latency(s);
+	s->async_pending = 0;
+	s->executed = true;
+	s->pos = 0;
+	s->cur = 0;
+	s->affected = 0;
+
+	// literal partitions, BETWEEN lo AND hi is inclusive and
+	// there are never any NULL ids
+	if(s->is_query)
+	{
+		size_t b = s->sql.find(" BETWEEN ");
+		if(b != std::string::npos)
+		{
+			long long l = 0, u = 0;
+			sscanf(s->sql.c_str() + b, " BETWEEN %lld AND %lld", &l, &u);
+			if(l < 0) l = 0;
+			if(u < s->rows - 1) s->rows = u + 1;
+			s->partition_lo = l;
+			s->rows = s->rows > l ? s->rows - l : 0;
+		}
+		else if(s->sql.find(" IS NULL") != std::string::npos)
+			s->rows = 0;
+	}
+	// MIN/MAX over the generated ids
+	if(s->sql.find("MIN(") != std::string::npos)
+	{
+		s->minmax = true;
+		s->max_id = s->rows - 1;
+		s->types = "i"; s->cols = 2; s->rows = 1; s->nulls = 0;
+	}
+
+	if(!s->is_query)
+	{
+		for(SQLULEN i=0;i<s->paramset_size;++i)
+			if(s->param_status) s->param_status[i] = SQL_PARAM_SUCCESS;
+		if(s->params_processed) *s->params_processed = s->paramset_size;
+		s->affected = s->paramset_size;
+		fake_inserted += s->paramset_size;
+	}
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLPrepare(SQLHSTMT h, SQLTCHAR *sql, SQLINTEGER len)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	std::string text = len == SQL_NTS ? std::string((char*)sql) : std::string((char*)sql, len);
+	latency(s);
+	parse(s, text);
+	s->prepared = true;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLExecute(SQLHSTMT h)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(!s->prepared) return SQL_ERROR;
+	parse(s, s->sql);
+	return run(s);
+}
+
+SQLRETURN SQLExecDirect(SQLHSTMT h, SQLTCHAR *sql, SQLINTEGER len)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(s->async_pending == 0) parse(s, len == SQL_NTS ? std::string((char*)sql) : std::string((char*)sql, len));
+	// marks the connection dead for SQL_ATTR_CONNECTION_DEAD
+	if(s->sql == "KILL") { s->dbc->dead = true; return SQL_SUCCESS; }
+	return run(s);
+}
+
+SQLRETURN SQLNumResultCols(SQLHSTMT h, SQLSMALLINT *cols)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	*cols = s->is_query ? (SQLSMALLINT)s->cols : 0;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLNumParams(SQLHSTMT, SQLSMALLINT *n) { ++fake_driver_calls; *n = 0; return SQL_SUCCESS; }
+
+SQLRETURN SQLDescribeCol(SQLHSTMT h, SQLUSMALLINT col, SQLTCHAR *name, SQLSMALLINT len, SQLSMALLINT *namelen, SQLSMALLINT *type, SQLULEN *size, SQLSMALLINT *decimals, SQLSMALLINT *nullable)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(col < 1 || col > s->cols) return SQL_ERROR;
+	char buf[32];
+	if(col == 1) snprintf(buf, sizeof(buf), "id"); else snprintf(buf, sizeof(buf), "col%d", col);
+	strncpy((char*)name, buf, len); name[len-1] = 0;
+	if(namelen) *namelen = (SQLSMALLINT)strlen(buf);
+	char k = col_kind(s, col);
+	*type = sql_type(k);
+	*size = k == 'i' ? 19 : k == 'd' ? 15 : k == 't' ? 19 : k == 'l' ? 0x7fffffff : s->width;
+	*decimals = 0;
+	*nullable = SQL_NULLABLE;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLColAttribute(SQLHSTMT h, SQLUSMALLINT col, SQLUSMALLINT field, SQLPOINTER, SQLSMALLINT, SQLSMALLINT*, SQLLEN *num)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(field != SQL_DESC_DISPLAY_SIZE) return SQL_ERROR;
+	char k = col_kind(s, col);
+	*num = k == 'i' ? 20 : k == 'd' ? 24 : k == 't' ? 19 : k == 'l' ? 0x7fffffff : k == 'b' ? s->width * 2 : s->width;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLBindCol(SQLHSTMT h, SQLUSMALLINT col, SQLSMALLINT c_type, SQLPOINTER ptr, SQLLEN len, SQLLEN *ind)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(!ptr) { s->bound.erase(col); return SQL_SUCCESS; }
+	fake_binding b = { c_type, ptr, len, ind };
+	s->bound[col] = b;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLFetch(SQLHSTMT h)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(!s->executed || !s->is_query) return SQL_ERROR;
+	if(s->async && s->async_pending == 0) { s->async_pending = 1; return SQL_STILL_EXECUTING; }
+	s->async_pending = 0;
+	latency(s);
+	s->getdata_col = 0;
+	s->getdata_off = 0;
+
+	if(s->pos >= s->rows)
+	{
+		if(s->rows_fetched) *s->rows_fetched = 0;
+		return SQL_NO_DATA;
+	}
+
+	SQLULEN n = 0;
+	SQLULEN offset = s->bind_offset ? *s->bind_offset : 0;
+	bool row_ok = true, errors = false;
+	s->cur = s->pos;
+
+	for(;n<s->array_size && s->pos<s->rows;++n,++s->pos)
+	{
+		for(std::map<int, fake_binding>::iterator it=s->bound.begin(); it!=s->bound.end(); ++it)
+		{
+			fake_binding &b = it->second;
+			char *ptr; SQLLEN *ind = 0;
+			if(s->bind_type == SQL_BIND_BY_COLUMN)
+			{
+				ptr = (char*)b.ptr + n * b.len;
+				if(b.ind) ind = b.ind + n;
+			}
+			else
+			{
+				ptr = (char*)b.ptr + n * s->bind_type + offset;
+				if(b.ind) ind = (SQLLEN*)((char*)b.ind + n * s->bind_type + offset);
+			}
+			SQLLEN len = b.len;
+			if(b.c_type == SQL_C_SBIGINT || b.c_type == SQL_C_DOUBLE) len = 8;
+			// a NULL with no indicator to report it fails the row (22002)
+			if(convert(s, s->pos, it->first, b.c_type, ptr, len, ind, 0, 0) == SQL_ERROR) row_ok = false;
+		}
+		if(s->row_status) s->row_status[n] = row_ok ? SQL_ROW_SUCCESS : SQL_ROW_ERROR;
+		if(!row_ok) errors = true;
+		row_ok = true;
+	}
+
+	for(SQLULEN i=n;i<s->array_size;++i)
+		if(s->row_status) s->row_status[i] = SQL_ROW_NOROW;
+	if(s->rows_fetched) *s->rows_fetched = n;
+
+	return errors ? SQL_SUCCESS_WITH_INFO : SQL_SUCCESS;
+}
+
+SQLRETURN SQLFetchScroll(SQLHSTMT h, SQLSMALLINT, SQLLEN) { return SQLFetch(h); }
+
+SQLRETURN SQLGetData(SQLHSTMT h, SQLUSMALLINT col, SQLSMALLINT c_type, SQLPOINTER ptr, SQLLEN len, SQLLEN *ind)
+{
+	++fake_driver_calls;
+	fake_stmt *s = (fake_stmt*)h;
+	if(!s->executed || col < 1 || col > s->cols) return SQL_ERROR;
+
+	if(s->getdata_col != col) { s->getdata_col = col; s->getdata_off = 0; }
+	else if(s->getdata_off == (size_t)-1) return SQL_NO_DATA;
+
+	size_t consumed = 0;
+	SQLRETURN rc = convert(s, s->cur, col, c_type, ptr, len, ind, s->getdata_off, &consumed);
+	if(rc == SQL_SUCCESS_WITH_INFO) s->getdata_off += consumed;
+	else s->getdata_off = (size_t)-1;
+	return rc;
+}
+
+SQLRETURN SQLRowCount(SQLHSTMT h, SQLLEN *n) { ++fake_driver_calls; *n = ((fake_stmt*)h)->affected; return SQL_SUCCESS; }
+SQLRETURN SQLMoreResults(SQLHSTMT) { ++fake_driver_calls; return SQL_NO_DATA; }
+
+SQLRETURN SQLGetDiagRec(SQLSMALLINT, SQLHANDLE, SQLSMALLINT rec, SQLTCHAR *state, SQLINTEGER *native, SQLTCHAR *text, SQLSMALLINT len, SQLSMALLINT *textlen)
+{
+	++fake_driver_calls;
+	if(rec > 1) return SQL_NO_DATA;
+	strcpy((char*)state, "HY000");
+	*native = 1;
+	snprintf((char*)text, len, "fake driver error");
+	if(textlen) *textlen = (SQLSMALLINT)strlen((char*)text);
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLGetDiagField(SQLSMALLINT, SQLHANDLE, SQLSMALLINT, SQLSMALLINT, SQLPOINTER, SQLSMALLINT, SQLSMALLINT*) { ++fake_driver_calls; return SQL_NO_DATA; }
+
+SQLRETURN SQLBindParameter(SQLHSTMT h, SQLUSMALLINT col, SQLSMALLINT, SQLSMALLINT c_type, SQLSMALLINT, SQLULEN, SQLSMALLINT, SQLPOINTER ptr, SQLLEN len, SQLLEN *ind)
+{
+	++fake_driver_calls;
+	fake_param p = { c_type, ptr, len, ind };
+	((fake_stmt*)h)->params[col] = p;
+	return SQL_SUCCESS;
+}
+
+SQLRETURN SQLParamData(SQLHSTMT, SQLPOINTER*) { ++fake_driver_calls; return SQL_SUCCESS; }
+SQLRETURN SQLPutData(SQLHSTMT, SQLPOINTER, SQLLEN) { ++fake_driver_calls; return SQL_SUCCESS; }
+
+}
@@ -0,0 +1,701 @@
+/*
+  Name: fetch_bench.cpp
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Benchmarks the fetch, execute and parameter binding paths
+               against the in-process fake driver, reporting rows/s,
+               bytes/s, heap allocations and p50/p99 latency
+*/
+
+// Build and run on Linux with the Makefile in this directory:
+//     make && ./build/fetch_bench rows=100000 cols=8 types=isdt width=32
+// Options, all optional:
+//     rows=n       rows per result set                  (100000)
+//     cols=n       columns per row                      (8)
+//     types=xyz    column types, see fake_driver.cpp    (isdt)
+//     width=n      VARCHAR/VARBINARY width              (32)
+//     nulls=n      every nth value is NULL, 0 for none  (0)
+//     rowset=n     rows per SQLFetch                    (256)
+//     iterations=n runs of each result set scenario     (20)
+//     ops=n        statements for the execute/bind runs (20000)
+//     latency=n    microseconds added per driver round trip (0)
+//     typed=1      fetch columns in their native C types
+//     metrics=1    record metrics on every connection and print the
+//                  build_result_set breakdown
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <new>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../odbc.h"
+
+typedef std::chrono::steady_clock bench_clock;
+
+// every heap allocation made by the process, the wrapper and the fake
+// driver alike, counted through the global operator new
+static std::atomic<size_t> heap_allocations(0);
+
+// every form is replaced so no allocation bypasses the count or is freed
+// by a library version, and none are inlined so GCC doesn't pair the
+// malloc inside with a new expression and warn of a mismatch
+#define BENCH_NOINLINE __attribute__((noinline))
+
+static void *counted_alloc(size_t size, size_t align)
+{
+    ++heap_allocations;
+
+    if(!size) size = 1;
+
+    if(align <= alignof(std::max_align_t))
+        return std::malloc(size);
+
+    return std::aligned_alloc(align, (size + align - 1) / align * align);
+}
+
+BENCH_NOINLINE void *operator new(size_t size)
+{
+    void *p = counted_alloc(size, 0);
+
+    if(!p) throw std::bad_alloc();
+
+    return p;
+}
+
+BENCH_NOINLINE void *operator new(size_t size, std::align_val_t align)
+{
+    void *p = counted_alloc(size, (size_t)align);
+
+    if(!p) throw std::bad_alloc();
+
+    return p;
+}
+
+BENCH_NOINLINE void *operator new[](size_t size) { return operator new(size); }
+BENCH_NOINLINE void *operator new[](size_t size, std::align_val_t align) { return operator new(size, align); }
+BENCH_NOINLINE void *operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+BENCH_NOINLINE void *operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size, 0); }
+BENCH_NOINLINE void *operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_alloc(size, (size_t)align); }
+BENCH_NOINLINE void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return counted_alloc(size, (size_t)align); }
+
+BENCH_NOINLINE void operator delete(void *p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void *p, size_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void *p, std::align_val_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void *p, const std::nothrow_t&) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete(void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p, size_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p, std::align_val_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p, size_t, std::align_val_t) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p, const std::nothrow_t&) noexcept { std::free(p); }
+BENCH_NOINLINE void operator delete[](void *p, std::align_val_t, const std::nothrow_t&) noexcept { std::free(p); }
+
+// settings taken from the command line as key=value pairs
+struct bench_options
+{
+    long rows;
+    long cols;
+    std::string types;
+    long width;
+    long nulls;
+    long rowset;
+    long iterations;
+    long ops;
+    long latency;
+    bool typed;
+    bool metrics;
+};
+
+// results of one scenario, latency is per iteration or per operation
+struct bench_result
+{
+    const char *name;
+    double seconds;
+    double rows;
+    double bytes;
+    double allocations;
+    std::vector<double> latency;
+};
+
+static long option(const std::map<std::string, std::string> &args, const char *key, long def)
+{
+    std::map<std::string, std::string>::const_iterator itr = args.find(key);
+
+    return itr != args.end() ? atol(itr->second.c_str()) : def;
+}
+
+static double elapsed(bench_clock::time_point start)
+{
+    return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+// returns the value at percentile p of the sorted latencies
+static double percentile(std::vector<double> &v, double p)
+{
+    size_t i;
+
+    if(v.empty()) return 0;
+
+    std::sort(v.begin(), v.end());
+    i = (size_t)(p * (v.size() - 1) + 0.5);
+
+    return v[i];
+}
+
+static std::string query(const bench_options &o)
+{
+    std::ostringstream sql;
+
+    sql << "FAKE rows=" << o.rows << " cols=" << o.cols << " types=" << o.types
+        << " width=" << o.width << " nulls=" << o.nulls << " latency=" << o.latency;
+
+    return sql.str();
+}
+
+// bytes of every value in the result set as stored, NULLs count as 0
+static double payload(const result_set &rs)
+{
+    double bytes = 0;
+    size_t row, col;
+
+    for(col=1;col<=rs.columns();++col)
+        for(row=0;row<rs.rows();++row)
+            bytes += rs.column(col).length(row);
+
+    return bytes;
+}
+
+static void report(bench_result &r)
+{
+    double p50 = percentile(r.latency, 0.50);
+    double p99 = percentile(r.latency, 0.99);
+
+    printf("%-26s %12.0f rows/s %9.1f MB/s %12.1f allocs/op %10.1f us p50 %10.1f us p99\n",
+           r.name, r.rows / r.seconds, r.bytes / r.seconds / 1048576.0,
+           r.allocations / (r.latency.empty() ? 1 : r.latency.size()), p50, p99);
+}
+
+static void connect(odbc &db, const bench_options &o)
+{
+    if(!db.connect())
+    {
+        printf("connect() failed\n");
+        exit(1);
+    }
+
+    db.set_rowset_size(o.rowset);
+    db.set_typed_fetch(o.typed);
+    db.set_metrics(o.metrics);
+}
+
+// where the build_result_set time went, per call
+static void report_metrics(const metrics_snapshot &m)
+{
+    int i;
+
+    printf("\nbuild_result_set metrics\n");
+
+    for(i=0;i<metric_timers;++i)
+        printf("%-10s %10llu calls %12.1f us mean %10.1f us p50 %10.1f us p99 %12.1f ms total\n",
+               metrics_snapshot::timer_name(i), m.timers[i].count, m.timers[i].mean_ns() / 1e3,
+               m.timers[i].percentile(0.50) / 1e3, m.timers[i].percentile(0.99) / 1e3,
+               m.timers[i].total_ns / 1e6);
+
+    for(i=0;i<metric_counters;++i)
+        printf("%-12s %llu\n", metrics_snapshot::counter_name(i), m.counters[i]);
+}
+
+// execute plus build_result_set() through results(), with a budget
+// the result set past it is spilled to a memory mapped temporary file
+static bench_result bench_results(const bench_options &o, double bytes, metrics_snapshot &m, size_t budget, const char *name)
+{
+    bench_result r = { name, 0, 0, 0, 0, std::vector<double>() };
+    std::string sql = query(o);
+    odbc db("fake");
+    long i;
+
+    connect(db, o);
+    db.set_memory_budget(budget);
+
+    for(i=0;i<o.iterations;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_direct(sql);
+        r.rows += db.results().rows();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+        r.bytes += bytes;
+    }
+
+    m = db.metrics();
+
+    return r;
+}
+
+// execute plus fetch_direct() over a view per row, prefetch is the
+// number of blocks read ahead on a background thread
+static bench_result bench_direct(const bench_options &o, double bytes, size_t prefetch, const char *name)
+{
+    bench_result r = { name, 0, 0, 0, 0, std::vector<double>() };
+    std::string sql = query(o);
+    odbc db("fake");
+    row_view v;
+    size_t seen = 0;
+    long i;
+
+    connect(db, o);
+    db.set_prefetch(prefetch);
+
+    for(i=0;i<o.iterations;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_direct(sql);
+
+        while(db.fetch_direct(v))
+        {
+            seen += v.is_null(1) ? 0 : 1;
+            r.rows += 1;
+        }
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+        r.bytes += bytes;
+    }
+
+    if(seen == 0) printf("%s returned no rows\n", name);
+
+    return r;
+}
+
+// one row of the isdt query fetch_rows() reads, width is capped to fit
+struct bench_row
+{
+    SQLBIGINT id;
+    char text[64];
+    double value;
+    SQL_TIMESTAMP_STRUCT stamp;
+};
+
+template<> struct row_mapping<bench_row>
+{
+    static void map(row_mapper<bench_row> &m)
+    {
+        m.column(1, &bench_row::id)
+         .column(2, &bench_row::text)
+         .column(3, &bench_row::value)
+         .column(4, &bench_row::stamp);
+    }
+};
+
+// execute plus fetch_rows() into a vector of structs over the first
+// four columns as isdt, the vector keeps its storage between runs
+static bench_result bench_rows(const bench_options &o)
+{
+    bench_result r = { "fetch_rows<struct> isdt", 0, 0, 0, 0, std::vector<double>() };
+    std::vector<bench_row> rows;
+    bench_options four = o;
+    odbc db("fake");
+    long i;
+
+    four.cols = 4;
+    four.types = "isdt";
+    four.width = std::min(o.width, 63L);
+    std::string sql = query(four);
+
+    connect(db, o);
+
+    for(i=0;i<o.iterations;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_direct(sql);
+        db.fetch_rows(rows);
+        r.rows += rows.size();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+        r.bytes += (double)rows.size() * sizeof(bench_row);
+    }
+
+    return r;
+}
+
+// a row whose size isn't a multiple of a SQLLEN, with no indicators of
+// its own, so fetch_rows() stages it to have somewhere to put its NULLs
+struct packed_row
+{
+    int id;
+    int a;
+    int b;
+};
+
+template<> struct row_mapping<packed_row>
+{
+    static void map(row_mapper<packed_row> &m)
+    {
+        m.column(1, &packed_row::id)
+         .column(2, &packed_row::a)
+         .column(3, &packed_row::b);
+    }
+};
+
+// execute plus fetch_rows() into 12 byte structs over three integer
+// columns with every third value NULL unless nulls says otherwise, every
+// row has to come back with its NULLs zeroed
+static bench_result bench_rows_packed(const bench_options &o)
+{
+    bench_result r = { "fetch_rows<struct> 12 byte", 0, 0, 0, 0, std::vector<double>() };
+    std::vector<packed_row> rows;
+    bench_options three = o;
+    odbc db("fake");
+    long i;
+
+    three.cols = 3;
+    three.types = "iii";
+    three.nulls = o.nulls ? o.nulls : 3;
+    std::string sql = query(three);
+
+    connect(db, o);
+
+    for(i=0;i<o.iterations;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_direct(sql);
+        db.fetch_rows(rows);
+        r.rows += rows.size();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+        r.bytes += (double)rows.size() * sizeof(packed_row);
+
+        if((long)rows.size() != o.rows)
+            printf("%s kept %lu of %ld rows\n", r.name, (unsigned long)rows.size(), o.rows);
+    }
+
+    return r;
+}
+
+// swallows what it is given, counting the bytes, so the Arrow run
+// measures encoding rather than the disk
+class null_buffer : public std::streambuf
+{
+    public:
+        null_buffer() : written(0) {}
+
+        long long written;
+
+    protected:
+        std::streamsize xsputn(const char*, std::streamsize n) { written += n; return n; }
+        int overflow(int c) { ++written; return c; }
+};
+
+// execute plus export_arrow() of the whole result as an Arrow IPC file,
+// bytes are the size of the file written
+static bench_result bench_arrow(const bench_options &o)
+{
+    bench_result r = { "export_arrow", 0, 0, 0, 0, std::vector<double>() };
+    std::string sql = query(o);
+    odbc db("fake");
+    long i;
+
+    connect(db, o);
+
+    for(i=0;i<o.iterations;++i)
+    {
+        null_buffer buf;
+        std::ostream out(&buf);
+        arrow_writer w(out);
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_direct(sql);
+
+        if(!db.export_arrow(w) || !w.end())
+        {
+            printf("export_arrow() failed\n");
+            exit(1);
+        }
+
+        r.rows += w.rows();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+        r.bytes += buf.written;
+    }
+
+    return r;
+}
+
+// prepare and execute of a single row query per operation
+static bench_result bench_prepare(const bench_options &o)
+{
+    bench_result r = { "prepare/execute", 0, 0, 0, 0, std::vector<double>() };
+    bench_options one = o;
+    odbc db("fake");
+    long i;
+
+    one.rows = 1;
+    std::string sql = query(one);
+
+    connect(db, o);
+
+    for(i=0;i<o.ops;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.prepare(sql);
+        db.execute();
+        r.rows += db.results().rows();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+    }
+
+    return r;
+}
+
+// a 100 row lookup per operation, execute_direct() and results() each
+// time against execute_cached() answering from a shared result cache
+static bench_result bench_lookup(const bench_options &o, bool cached, const char *name)
+{
+    bench_result r = { name, 0, 0, 0, 0, std::vector<double>() };
+    std::shared_ptr<result_cache> cache(new result_cache());
+    std::shared_ptr<const result_set> rs;
+    bench_options lookup = o;
+    odbc db("fake");
+    long i;
+
+    lookup.rows = 100;
+    std::string sql = query(lookup);
+
+    connect(db, o);
+    if(cached) db.set_result_cache(cache);
+
+    for(i=0;i<o.ops;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        if(cached)
+        {
+            db.execute_cached(sql, rs, std::chrono::minutes(1), std::vector<std::string>(1, "lookup"));
+            r.rows += rs->rows();
+        }
+        else
+        {
+            db.execute_direct(sql);
+            r.rows += db.results().rows();
+        }
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+    }
+
+    return r;
+}
+
+// one bind_param() per column and an execute per row
+static bench_result bench_bind(const bench_options &o)
+{
+    bench_result r = { "bind_param/execute", 0, 0, 0, 0, std::vector<double>() };
+    odbc db("fake");
+    std::string value(o.width, 'x');
+    long i, col;
+
+    connect(db, o);
+    db.prepare("INSERT fake");
+
+    for(i=0;i<o.ops;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        for(col=1;col<=o.cols;++col)
+            db.bind_param((short)col, value, SQL_VARCHAR, o.width, 0);
+        db.execute();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.rows += 1;
+        r.bytes += (double)o.cols * o.width;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+    }
+
+    return r;
+}
+
+// the same through bind<T>() with an integer column in front, the
+// statement's buffers are reused so steady state allocates nothing
+static bench_result bench_bind_typed(const bench_options &o)
+{
+    bench_result r = { "bind<T>/execute", 0, 0, 0, 0, std::vector<double>() };
+    odbc db("fake");
+    std::string value(o.width, 'x');
+    long i, col;
+
+    connect(db, o);
+    db.prepare("INSERT fake");
+
+    for(i=0;i<o.ops;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.bind(1, (long long)i);
+        for(col=2;col<=o.cols;++col)
+            db.bind((SQLUSMALLINT)col, value);
+        db.execute();
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.rows += 1;
+        r.bytes += (double)(o.cols - 1) * o.width + sizeof(long long);
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+    }
+
+    return r;
+}
+
+// column-wise arrays of rowset sets per execute_batch()
+static bench_result bench_batch(const bench_options &o)
+{
+    bench_result r = { "execute_batch", 0, 0, 0, 0, std::vector<double>() };
+    std::vector<param_array> params(o.cols);
+    odbc db("fake");
+    long i, col, batches;
+
+    connect(db, o);
+    db.prepare("INSERT fake");
+
+    for(col=0;col<o.cols;++col)
+    {
+        params[col].col = (SQLSMALLINT)(col+1);
+        params[col].vals.assign(o.rowset, std::string(o.width, 'x'));
+        params[col].type = SQL_VARCHAR;
+        params[col].size = o.width;
+        params[col].decimals = 0;
+    }
+
+    batches = o.ops / o.rowset ? o.ops / o.rowset : 1;
+
+    for(i=0;i<batches;++i)
+    {
+        size_t allocs = heap_allocations;
+        bench_clock::time_point start = bench_clock::now();
+
+        db.execute_batch(params);
+
+        double t = elapsed(start);
+        r.seconds += t;
+        r.rows += db.batch_processed();
+        r.bytes += (double)o.rowset * o.cols * o.width;
+        r.latency.push_back(t * 1e6);
+        r.allocations += heap_allocations - allocs;
+    }
+
+    return r;
+}
+
+int main(int argc, char **argv)
+{
+    std::map<std::string, std::string> args;
+    bench_options o;
+    int i;
+
+    for(i=1;i<argc;++i)
+    {
+        const char *eq = strchr(argv[i], '=');
+
+        if(eq) args[std::string(argv[i], eq - argv[i])] = eq + 1;
+    }
+
+    o.rows = option(args, "rows", 100000);
+    o.cols = option(args, "cols", 8);
+    o.types = args.count("types") ? args["types"] : "isdt";
+    o.width = option(args, "width", 32);
+    o.nulls = option(args, "nulls", 0);
+    o.rowset = option(args, "rowset", 256);
+    o.iterations = option(args, "iterations", 20);
+    o.ops = option(args, "ops", 20000);
+    o.latency = option(args, "latency", 0);
+    o.typed = option(args, "typed", 0) != 0;
+    o.metrics = option(args, "metrics", 0) != 0;
+
+    if(o.rows < 1 || o.cols < 1 || o.rowset < 1 || o.iterations < 1 || o.ops < 1 || o.types.empty())
+    {
+        printf("rows, cols, rowset, iterations and ops must be at least 1\n");
+        return 1;
+    }
+
+    // bytes per result set as the wrapper stores them
+    double bytes;
+    {
+        odbc db("fake");
+        connect(db, o);
+        db.execute_direct(query(o));
+        bytes = payload(db.results());
+    }
+
+    printf("%ld rows x %ld columns, types=%s width=%ld nulls=%ld rowset=%ld typed=%d latency=%ldus metrics=%d\n",
+           o.rows, o.cols, o.types.c_str(), o.width, o.nulls, o.rowset, (int)o.typed, o.latency, (int)o.metrics);
+    printf("latency is per result set for the fetch runs and per statement for the rest\n\n");
+
+    metrics_snapshot m, spilled;
+    bench_result runs[] =
+    {
+        bench_results(o, bytes, m, 0, "build_result_set"),
+        bench_results(o, bytes, spilled, 1048576, "build_result_set 1MB"),
+        bench_direct(o, bytes, 0, "fetch_direct"),
+        bench_direct(o, bytes, 2, "fetch_direct prefetch=2"),
+        bench_rows(o),
+        bench_rows_packed(o),
+        bench_arrow(o),
+        bench_prepare(o),
+        bench_lookup(o, false, "lookup execute_direct"),
+        bench_lookup(o, true, "lookup execute_cached"),
+        bench_bind(o),
+        bench_bind_typed(o),
+        bench_batch(o)
+    };
+
+    for(i=0;i<(int)(sizeof(runs)/sizeof(runs[0]));++i)
+        report(runs[i]);
+
+    if(o.metrics) report_metrics(m);
+
+    return 0;
+}
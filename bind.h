@@ -0,0 +1,222 @@
+/*
+  Name: bind.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Compile time parameter types for statement::bind<T>()
+               Each supported C++ type maps to its ODBC C type, SQL type
+               and length so values are bound in their native form with
+               no string conversion
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef BIND_H
+#define BIND_H
+
+#include <cstring>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+// bytes bound as VARBINARY, bind() copies them so they only need to
+// live for the call
+struct byte_span
+{
+	const void *data;
+	size_t size;
+
+	byte_span() : data(NULL), size(0) {}
+	byte_span(const void *bytes, size_t len) : data(bytes), size(len) {}
+	byte_span(const std::vector<unsigned char> &bytes) : data(bytes.data()), size(bytes.size()) {}
+};
+
+// Types and length of a value bound through bind<T>(), fixed types are
+// copied or bound where they are, variable ones (strings and byte spans)
+// are copied into a buffer that grows to the longest value bound
+// Types without a specialisation don't compile
+template<class T, class Enable = void>
+struct param_traits;
+
+// integers take the C and SQL types of their width and signedness,
+// size is the number of decimal digits
+template<class T>
+struct param_traits<T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type()
+	{
+		if(std::is_signed<T>::value)
+			return sizeof(T) == 1 ? SQL_C_STINYINT : sizeof(T) == 2 ? SQL_C_SSHORT : sizeof(T) == 4 ? SQL_C_SLONG : SQL_C_SBIGINT;
+
+		return sizeof(T) == 1 ? SQL_C_UTINYINT : sizeof(T) == 2 ? SQL_C_USHORT : sizeof(T) == 4 ? SQL_C_ULONG : SQL_C_UBIGINT;
+	}
+
+	static SQLSMALLINT sql_type() { return sizeof(T) == 1 ? SQL_TINYINT : sizeof(T) == 2 ? SQL_SMALLINT : sizeof(T) == 4 ? SQL_INTEGER : SQL_BIGINT; }
+	static SQLULEN size(const T&) { return sizeof(T) == 1 ? 3 : sizeof(T) == 2 ? 5 : sizeof(T) == 4 ? 10 : 19; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const T &value) { return &value; }
+	static SQLLEN length(const T&) { return sizeof(T); }
+};
+
+template<>
+struct param_traits<bool>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_BIT; }
+	static SQLSMALLINT sql_type() { return SQL_BIT; }
+	static SQLULEN size(const bool&) { return 1; }
+	static SQLSMALLINT decimals() { return 0; }
+	// SQL_C_BIT is one byte, which a bool need not be
+	static const void *data(const bool &value) { static const unsigned char bits[2] = { 0, 1 }; return &bits[value ? 1 : 0]; }
+	static SQLLEN length(const bool&) { return 1; }
+};
+
+template<>
+struct param_traits<float>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_FLOAT; }
+	static SQLSMALLINT sql_type() { return SQL_REAL; }
+	static SQLULEN size(const float&) { return 7; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const float &value) { return &value; }
+	static SQLLEN length(const float&) { return sizeof(float); }
+};
+
+template<>
+struct param_traits<double>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_DOUBLE; }
+	static SQLSMALLINT sql_type() { return SQL_DOUBLE; }
+	static SQLULEN size(const double&) { return 15; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const double &value) { return &value; }
+	static SQLLEN length(const double&) { return sizeof(double); }
+};
+
+// microsecond precision, which most servers can store without
+// rounding, the fraction field is in nanoseconds either way
+template<>
+struct param_traits<SQL_TIMESTAMP_STRUCT>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_TYPE_TIMESTAMP; }
+	static SQLSMALLINT sql_type() { return SQL_TYPE_TIMESTAMP; }
+	static SQLULEN size(const SQL_TIMESTAMP_STRUCT&) { return 26; }
+	static SQLSMALLINT decimals() { return 6; }
+	static const void *data(const SQL_TIMESTAMP_STRUCT &value) { return &value; }
+	static SQLLEN length(const SQL_TIMESTAMP_STRUCT&) { return sizeof(SQL_TIMESTAMP_STRUCT); }
+};
+
+template<>
+struct param_traits<SQL_DATE_STRUCT>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_TYPE_DATE; }
+	static SQLSMALLINT sql_type() { return SQL_TYPE_DATE; }
+	static SQLULEN size(const SQL_DATE_STRUCT&) { return 10; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const SQL_DATE_STRUCT &value) { return &value; }
+	static SQLLEN length(const SQL_DATE_STRUCT&) { return sizeof(SQL_DATE_STRUCT); }
+};
+
+template<>
+struct param_traits<SQL_TIME_STRUCT>
+{
+	static const bool fixed = true;
+
+	static SQLSMALLINT c_type() { return SQL_C_TYPE_TIME; }
+	static SQLSMALLINT sql_type() { return SQL_TYPE_TIME; }
+	static SQLULEN size(const SQL_TIME_STRUCT&) { return 8; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const SQL_TIME_STRUCT &value) { return &value; }
+	static SQLLEN length(const SQL_TIME_STRUCT&) { return sizeof(SQL_TIME_STRUCT); }
+};
+
+// strings go as the build's character type, variable types report a
+// size of 0 which leaves the column size to the statement, it uses the
+// capacity of the buffer it copies them into so the binding stays the
+// same until a longer value comes along
+template<>
+struct param_traits<TSTRVIEW>
+{
+	static const bool fixed = false;
+
+	static SQLSMALLINT c_type() { return SQL_C_TCHAR; }
+#if defined(UNICODE) || defined(_UNICODE_)
+	static SQLSMALLINT sql_type() { return SQL_WVARCHAR; }
+#else
+	static SQLSMALLINT sql_type() { return SQL_VARCHAR; }
+#endif
+	static SQLULEN size(const TSTRVIEW&) { return 0; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const TSTRVIEW &value) { return value.data(); }
+	static SQLLEN length(const TSTRVIEW &value) { return value.size()*sizeof(TCHAR); }
+};
+
+template<>
+struct param_traits<TSTR> : param_traits<TSTRVIEW>
+{
+	static const void *data(const TSTR &value) { return value.data(); }
+	static SQLLEN length(const TSTR &value) { return value.size()*sizeof(TCHAR); }
+};
+
+template<>
+struct param_traits<byte_span>
+{
+	static const bool fixed = false;
+
+	static SQLSMALLINT c_type() { return SQL_C_BINARY; }
+	static SQLSMALLINT sql_type() { return SQL_VARBINARY; }
+	static SQLULEN size(const byte_span&) { return 0; }
+	static SQLSMALLINT decimals() { return 0; }
+	static const void *data(const byte_span &value) { return value.data; }
+	static SQLLEN length(const byte_span &value) { return (SQLLEN)value.size; }
+};
+
+template<>
+struct param_traits<std::vector<unsigned char> > : param_traits<byte_span>
+{
+	static const void *data(const std::vector<unsigned char> &value) { return value.data(); }
+	static SQLLEN length(const std::vector<unsigned char> &value) { return (SQLLEN)value.size(); }
+};
+
+// statement owned copy of one bound parameter, fixed values are copied
+// into value and variable ones into data, which only ever grows, so
+// binding the same column again allocates nothing
+// The binding last made is remembered so an identical one, the same
+// pointer, length and types, isn't made again, only indicator changes
+struct param_buffer
+{
+	bool bound;
+	SQLSMALLINT c_type;
+	SQLSMALLINT sql_type;
+	SQLULEN size;
+	SQLSMALLINT decimals;
+	SQLPOINTER ptr;
+	SQLLEN buffer_len;
+	SQLLEN indicator;
+
+	// large enough and aligned for any fixed type above
+	union
+	{
+		SQL_TIMESTAMP_STRUCT timestamp;
+		SQLBIGINT integer;
+		SQLDOUBLE real;
+		unsigned char bytes[32];
+	} value;
+	std::vector<unsigned char> data;
+
+	param_buffer() : bound(false), c_type(0), sql_type(0), size(0), decimals(0), ptr(NULL), buffer_len(0), indicator(0) {}
+};
+
+
+#endif
@@ -0,0 +1,118 @@
+/*
+  Name: coro.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: C++20 coroutine types over the streaming fetch path
+               row_generator lazily yields the rows of fetch_direct() and
+               block_awaitable suspends a coroutine while the next block
+               is fetched on a worker thread
+*/
+
+// Relies on the ODBC types, include through odbc.h
+// Only compiled when the compiler supports coroutines, e.g. -std=c++20
+
+#ifndef CORO_H
+#define CORO_H
+
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+    #if __has_include(<coroutine>)
+        #define ODBC_COROUTINES
+    #endif
+#endif
+
+#if defined(ODBC_COROUTINES)
+
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include "async.h"
+
+// Lazy, single pass generator of row_views, each view is only valid
+// until the generator is advanced, same as fetch_direct()
+class row_generator
+{
+    public:
+        struct promise_type
+        {
+            const row_view *current;
+
+            row_generator get_return_object() { return row_generator(std::coroutine_handle<promise_type>::from_promise(*this)); }
+            std::suspend_always initial_suspend() noexcept { return std::suspend_always(); }
+            std::suspend_always final_suspend() noexcept { return std::suspend_always(); }
+            std::suspend_always yield_value(const row_view &r) { current = &r; return std::suspend_always(); }
+            void return_void() {}
+            void unhandled_exception() { throw; }
+        };
+
+        class iterator
+        {
+            public:
+                iterator() : _h(nullptr) {}
+                explicit iterator(std::coroutine_handle<promise_type> h) : _h(h) {}
+
+                const row_view &operator*() const { return *_h.promise().current; }
+                const row_view *operator->() const { return _h.promise().current; }
+                iterator &operator++() { _h.resume(); return *this; }
+
+                bool operator==(std::default_sentinel_t) const { return !_h || _h.done(); }
+                bool operator!=(std::default_sentinel_t s) const { return !(*this == s); }
+
+            private:
+                std::coroutine_handle<promise_type> _h;
+        };
+
+        row_generator(row_generator &&other) : _h(other._h) { other._h = nullptr; }
+        row_generator(const row_generator&) = delete;
+        row_generator &operator=(const row_generator&) = delete;
+        ~row_generator() { if(_h) _h.destroy(); }
+
+        // the first row is fetched by begin()
+        iterator begin() { if(_h) _h.resume(); return iterator(_h); }
+        std::default_sentinel_t end() { return std::default_sentinel; }
+
+    private:
+        explicit row_generator(std::coroutine_handle<promise_type> h) : _h(h) {}
+
+        std::coroutine_handle<promise_type> _h;
+};
+
+// Awaitable that runs a blocking fetch on the shared executor's workers
+// and resumes the awaiting coroutine with its result, through resume when
+// one is given, e.g. a function posting the handle back to an event loop,
+// otherwise straight on the worker thread
+class block_awaitable
+{
+    public:
+        typedef std::function<void(std::coroutine_handle<>)> resumer;
+
+        block_awaitable(std::function<bool()> fetch, resumer resume)
+            : _fetch(fetch), _resume(resume), _result(false) {}
+
+        bool await_ready() const noexcept { return false; }
+
+        void await_suspend(std::coroutine_handle<> h)
+        {
+            async_executor::shared().run([this, h]
+            {
+                _result = _fetch();
+
+                if(_resume)
+                    _resume(h);
+                else
+                    h.resume();
+            });
+        }
+
+        bool await_resume() const noexcept { return _result; }
+
+    private:
+        std::function<bool()> _fetch;
+        resumer _resume;
+        bool _result;
+};
+
+#endif
+
+
+#endif
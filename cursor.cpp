@@ -0,0 +1,891 @@
+#include "headers\odbc.h"
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+cursor::cursor()
+{
+	_hstmt = NULL;
+	_rc = SQL_SUCCESS;
+	_rowset_size = 1;
+	_rows_fetched = 0;
+	_pos = 0;
+	_row_id = 0;
+	_first_unbound = 0;
+	_open = false;
+	_typed = false;
+	_stream_lobs = false;
+	_prefetch = 0;
+	_prefetching = false;
+	_prefetch_done = false;
+	_prefetch_stop = false;
+	_metrics = NULL;
+	_getdata_calls = 0;
+	_failed_rows = 0;
+}
+
+cursor::~cursor()
+{
+	close();
+}
+
+// describes and binds once, every block after this reuses the buffers
+bool cursor::open(SQLHANDLE hstmt, SQLULEN rowset_size, bool typed, bool stream_lobs)
+{
+	close();
+
+	_hstmt = hstmt;
+	_rowset_size = rowset_size ? rowset_size : 1;
+	_typed = typed;
+	_stream_lobs = stream_lobs;
+	_row_id = 0;
+	_failed_rows = 0;
+	_failed_diag.clear();
+
+	metrics_timer timer(_metrics, metric_describe);
+
+	if(!_hstmt || !describe() || !bind())
+	{
+		close();
+		return false;
+	}
+
+	timer.stop();
+
+	// SQLNumResultCols, SQLDescribeCol and SQLBindCol per column
+	// and the four block attributes, column_width() counts its own
+	// SQLColAttribute calls
+	if(_metrics) _metrics->add(metric_driver_calls, 1 + fields() + (_first_unbound-1) + 4);
+
+	_block.reset(_schema);
+	_pos = 0;
+	_open = true;
+
+	if(_prefetch && !_stream_lobs)
+	{
+		_prefetching = true;
+		_prefetch_done = false;
+		_prefetch_stop = false;
+		_prefetcher = std::thread(&cursor::prefetch_loop, this);
+	}
+
+	return true;
+}
+
+void cursor::close()
+{
+	stop_prefetch();
+
+	if(_open && _hstmt)
+	{
+		SQLFreeStmt(_hstmt, SQL_UNBIND);
+		SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+		SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_STATUS_PTR, NULL, 0);
+		SQLSetStmtAttr(_hstmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+	}
+
+	_block.clear_rows();
+	_rows_fetched = 0;
+	_pos = 0;
+	_open = false;
+}
+
+bool cursor::is_open()
+{
+	return _open;
+}
+
+// decodes a block at a time into _block and then walks it,
+// the block is emptied rather than freed so its storage is reused
+bool cursor::next()
+{
+	if(!_open) return false;
+
+	if(_prefetching)
+	{
+		while(!_ahead || _pos >= _ahead->rows())
+		{
+			if(!take_block()) return false;
+		}
+
+		++_pos;
+		++_row_id;
+
+		return true;
+	}
+
+	while(_pos >= _block.rows())
+	{
+		_block.clear_rows();
+		_pos = 0;
+
+		if(!fetch_into(_block)) return false;
+	}
+
+	++_pos;
+	++_row_id;
+
+	return true;
+}
+
+row_view cursor::current()
+{
+	if(_prefetching) return _ahead->row(_pos);
+
+	return _block.row(_pos);
+}
+
+unsigned long cursor::row_id()
+{
+	return _row_id;
+}
+
+// text comes out as narrow bytes so the reader can feed a std::istream
+lob_reader cursor::open_lob(SQLUSMALLINT col)
+{
+	SQLSMALLINT type;
+
+	if(!_open || col < 1 || col > fields()) return lob_reader();
+
+	type = _schema->column(col).sql_type;
+
+	if(type == SQL_BINARY || type == SQL_VARBINARY || type == SQL_LONGVARBINARY)
+		return open_lob(col, SQL_C_BINARY);
+
+	return open_lob(col, SQL_C_CHAR);
+}
+
+lob_reader cursor::open_lob(SQLUSMALLINT col, SQLSMALLINT c_type)
+{
+	if(!_open || !_stream_lobs || !_pos || col < _first_unbound || col > fields())
+		return lob_reader();
+
+	return lob_reader(_hstmt, col, c_type);
+}
+
+// while prefetching the rows come out of the next decoded
+// block, which costs a copy but keeps the driver busy
+bool cursor::fetch_into(result_set &rs)
+{
+	if(!_open) return false;
+
+	if(_prefetching)
+	{
+		if(_ahead && _pos < _ahead->rows())
+		{
+			rs.append_rows(*_ahead, _pos);
+			_pos = _ahead->rows();
+			return true;
+		}
+
+		if(!take_block()) return false;
+
+		rs.append_rows(*_ahead, 0);
+		_pos = _ahead->rows();
+		return true;
+	}
+
+	return fetch_rowset(rs);
+}
+
+// each block lands at the end of rows, which grows by a rowset before
+// the fetch and is cut back to the rows kept after it, the columns are
+// bound again per block as the rows move along and may be reallocated
+bool cursor::fetch_rows(SQLHANDLE hstmt, SQLULEN rowset_size, const row_layout &layout, row_sink &rows, size_t max_rows)
+{
+	std::vector<SQLUSMALLINT> cols(layout.members.size());
+	odbc_metrics::clock::time_point start;
+	bool timed = _metrics && _metrics->enabled();
+	bool described = false;
+	size_t kept = 0, i, pos, n, lanes, stride, spare;
+	SQLULEN block;
+	unsigned char *base, *fetched;
+
+	if(_open || !hstmt) return false;
+
+	_hstmt = hstmt;
+	_rowset_size = rowset_size ? rowset_size : 1;
+	_rc = SQL_SUCCESS;
+	_unmapped.clear();
+
+	// names are looked up in the described result set
+	for(i=0;i<layout.members.size();++i)
+	{
+		cols[i] = layout.members[i].col;
+
+		if(cols[i]) continue;
+
+		if(!described)
+		{
+			metrics_timer timer(_metrics, metric_describe);
+
+			if(!describe()) return false;
+			described = true;
+
+			if(_metrics) _metrics->add(metric_driver_calls, 1 + fields());
+		}
+
+		if(!(cols[i] = (SQLUSMALLINT)_schema->find(layout.members[i].name)))
+		{
+			_unmapped = layout.members[i].name;
+			_rc = SQL_ERROR;
+			return false;
+		}
+	}
+
+	if(max_rows && max_rows < _rowset_size)
+		_rowset_size = max_rows;
+
+	for(i=0,n=0;i<layout.members.size();++i)
+		if(layout.members[i].indicator == (size_t)-1) ++n;
+
+	// members without an indicator of their own need one anyway, as the
+	// driver fails a row with a NULL it has nowhere to report, the
+	// driver steps every indicator by the row stride so they are kept in
+	// lanes, one SQLLEN per row stride, when the stride is a whole number
+	// of SQLLENs, otherwise rows are fetched into a staging block whose
+	// stride is the struct padded to a SQLLEN with the indicators after
+	// it, and copied across once their NULLs have been zeroed
+	lanes = n && layout.row_size % sizeof(SQLLEN) == 0 ? layout.row_size / sizeof(SQLLEN) : 0;
+	spare = (layout.row_size + sizeof(SQLLEN) - 1) / sizeof(SQLLEN) * sizeof(SQLLEN);
+	stride = (n && !lanes) ? spare + n*sizeof(SQLLEN) : layout.row_size;
+
+	if(lanes)
+		_indicators.resize((n + lanes - 1) / lanes * _rowset_size * lanes);
+	else if(n)
+		_indicators.resize(_rowset_size * stride / sizeof(SQLLEN));
+
+	_row_status.assign(_rowset_size, SQL_ROW_NOROW);
+	_rows_fetched = 0;
+
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)stride, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_STATUS_PTR, &_row_status[0], 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &_rows_fetched, 0);
+	_rc = SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)_rowset_size, 0);
+
+	block = _rowset_size;
+
+	while(SQL_SUCCEEDED(_rc))
+	{
+		if(max_rows && max_rows - kept < block)
+		{
+			block = max_rows - kept;
+			SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)block, 0);
+		}
+
+		base = rows.resize(kept + block) + kept*layout.row_size;
+		fetched = (stride == layout.row_size) ? base : (unsigned char*)&_indicators[0];
+
+		if(!bind_rows(layout, cols, fetched, lanes)) break;
+
+		if(timed) start = odbc_metrics::clock::now();
+
+		_rc = SQLFetch(_hstmt);
+
+		if(timed)
+		{
+			_metrics->record(metric_fetch, odbc_metrics::clock::now() - start);
+			_metrics->add(metric_driver_calls, 1 + cols.size());
+		}
+
+		if(!SQL_SUCCEEDED(_rc)) break;
+
+		count_failed_rows(_T("fetch_rows()"));
+
+		// NULLs read into members without an indicator are zeroed and
+		// rows that failed are closed up so the rows kept stay contiguous
+		for(pos=0,n=0;pos<_rows_fetched;++pos)
+		{
+			unsigned char *row = fetched + pos*stride;
+			size_t lane = 0;
+			SQLLEN ind;
+
+			if(_row_status[pos] != SQL_ROW_SUCCESS &&
+			   _row_status[pos] != SQL_ROW_SUCCESS_WITH_INFO)
+				continue;
+
+			for(i=0;i<layout.members.size();++i)
+			{
+				const row_member &m = layout.members[i];
+
+				if(m.indicator != (size_t)-1) continue;
+
+				if(lanes)
+					ind = _indicators[(lane / lanes * _rowset_size + pos) * lanes + lane % lanes];
+				else
+					memcpy(&ind, row + spare + lane*sizeof(SQLLEN), sizeof(ind));
+
+				if(ind == SQL_NULL_DATA)
+					memset(row + m.offset, 0, m.width);
+
+				++lane;
+			}
+
+			if(row != base + n*layout.row_size)
+				memmove(base + n*layout.row_size, row, layout.row_size);
+			++n;
+		}
+
+		kept += n;
+
+		if(timed)
+		{
+			_metrics->add(metric_rows, n);
+			_metrics->add(metric_bytes, n*layout.row_size);
+		}
+
+		if(max_rows && kept >= max_rows) break;
+	}
+
+	rows.resize(kept);
+
+	SQLFreeStmt(_hstmt, SQL_UNBIND);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)1, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_STATUS_PTR, NULL, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROWS_FETCHED_PTR, NULL, 0);
+	_rows_fetched = 0;
+
+	if(_rc == SQL_NO_DATA)
+	{
+		if(!kept) return false;
+		_rc = SQL_SUCCESS;
+	}
+
+	return SQL_SUCCEEDED(_rc);
+}
+
+const TSTR &cursor::unmapped_column()
+{
+	return _unmapped;
+}
+
+// the count is checked before locking so a fetch without failed rows,
+// the usual case, costs one atomic load
+unsigned long cursor::take_failed_rows(std::vector<diag_record> &records)
+{
+	if(!_failed_rows) return 0;
+
+	std::lock_guard<std::mutex> lock(_prefetch_lock);
+
+	records = _failed_diag.records();
+	_failed_diag.clear();
+
+	return _failed_rows.exchange(0);
+}
+
+void cursor::set_prefetch(size_t blocks)
+{
+	_prefetch = blocks;
+}
+
+size_t cursor::prefetch()
+{
+	return _prefetch;
+}
+
+void cursor::set_metrics(odbc_metrics *metrics)
+{
+	_metrics = metrics;
+}
+
+std::shared_ptr<const result_schema> cursor::schema()
+{
+	return _schema;
+}
+
+SQLUSMALLINT cursor::fields()
+{
+	return _schema ? (SQLUSMALLINT)_schema->columns() : 0;
+}
+
+SQLRETURN cursor::last_status()
+{
+	return _rc;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// the driver's time is SQLFetch plus the SQLGetData calls made while
+// decoding, whatever else decoding took is the wrapper's own
+bool cursor::fetch_rowset(result_set &rs)
+{
+	odbc_metrics::clock::time_point start, fetched;
+	bool timed = _metrics && _metrics->enabled();
+	size_t rows = 0, bytes = 0;
+
+	if(timed) start = odbc_metrics::clock::now();
+
+	_rc = SQLFetch(_hstmt);
+
+	if(timed)
+	{
+		fetched = odbc_metrics::clock::now();
+		_getdata_time = odbc_metrics::clock::duration::zero();
+		_getdata_calls = 0;
+		rows = rs.rows();
+		bytes = rs.bytes();
+	}
+
+	if(!SQL_SUCCEEDED(_rc))
+	{
+		if(timed)
+		{
+			_metrics->record(metric_fetch, fetched - start);
+			_metrics->add(metric_driver_calls);
+		}
+
+		_rows_fetched = 0;
+		return false;
+	}
+
+	count_failed_rows(_T("fetch()"));
+	decode(rs);
+
+	if(timed)
+	{
+		_metrics->record(metric_fetch, fetched - start + _getdata_time);
+		_metrics->record(metric_decode, odbc_metrics::clock::now() - fetched - _getdata_time);
+		_metrics->add(metric_driver_calls, 1 + _getdata_calls);
+		_metrics->add(metric_rows, rs.rows() - rows);
+		_metrics->add(metric_bytes, rs.bytes() - bytes);
+	}
+
+	return true;
+}
+
+// only this thread touches the statement handle, the bound buffers,
+// _rc and _rows_fetched until it has been joined
+void cursor::prefetch_loop()
+{
+	std::unique_ptr<result_set> block;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_prefetch_lock);
+			_spare_wake.wait(lock, [this]{ return _prefetch_stop || _filled.size() < _prefetch; });
+
+			if(_prefetch_stop) break;
+
+			if(!_spare.empty())
+			{
+				block = std::move(_spare.back());
+				_spare.pop_back();
+			}
+			else
+				block.reset(new result_set());
+		}
+
+		if(block->schema_ptr() != _schema)
+			block->reset(_schema);
+
+		if(!fetch_rowset(*block))
+		{
+			std::lock_guard<std::mutex> lock(_prefetch_lock);
+			_spare.push_back(std::move(block));
+			break;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(_prefetch_lock);
+			_filled.push_back(std::move(block));
+		}
+
+		_filled_wake.notify_one();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_prefetch_lock);
+		_prefetch_done = true;
+	}
+
+	_filled_wake.notify_all();
+}
+
+bool cursor::take_block()
+{
+	std::unique_lock<std::mutex> lock(_prefetch_lock);
+
+	if(_ahead)
+	{
+		_ahead->clear_rows();
+		_spare.push_back(std::move(_ahead));
+		_spare_wake.notify_one();
+	}
+
+	_pos = 0;
+
+	_filled_wake.wait(lock, [this]{ return _prefetch_done || !_filled.empty(); });
+
+	if(_filled.empty()) return false;
+
+	_ahead = std::move(_filled.front());
+	_filled.pop_front();
+
+	return true;
+}
+
+// blocks still queued are emptied and kept for the next open
+void cursor::stop_prefetch()
+{
+	if(!_prefetching) return;
+
+	{
+		std::lock_guard<std::mutex> lock(_prefetch_lock);
+		_prefetch_stop = true;
+	}
+
+	_spare_wake.notify_all();
+	_prefetcher.join();
+
+	while(!_filled.empty())
+	{
+		_filled.front()->clear_rows();
+		_spare.push_back(std::move(_filled.front()));
+		_filled.pop_front();
+	}
+
+	if(_ahead)
+	{
+		_ahead->clear_rows();
+		_spare.push_back(std::move(_ahead));
+	}
+
+	_prefetching = false;
+}
+
+// describes each column into a fresh schema, names are
+// stored once here rather than in every field
+bool cursor::describe()
+{
+	field_description c;
+	SQLSMALLINT fields = 0;
+
+	_schema.reset(new result_schema());
+
+	_rc = SQLNumResultCols(_hstmt, &fields);
+	if(!SQL_SUCCEEDED(_rc)) return false;
+
+	for(c.colNumber=1;c.colNumber<=fields;++c.colNumber)
+	{
+		_rc = Describe(c);
+		if(!SQL_SUCCEEDED(_rc)) return false;
+
+		column_info info;
+		info.name = (TCHAR*)c.colName;
+		info.sql_type = c.dataType;
+		info.c_type = fetch_type(c);
+		info.size = c.colSize;
+		info.decimals = c.decimalDigits;
+		info.nullable = c.nullable;
+		info.lob = is_long(c);
+
+		_schema->add_column(info);
+	}
+
+	return true;
+}
+
+// the driver steps every pointer, indicators included, by the row
+// stride, members without an indicator of their own get one from a
+// lane of _indicators when lanes is set, otherwise base is the staging
+// block and theirs sit after the padded struct
+bool cursor::bind_rows(const row_layout &layout, const std::vector<SQLUSMALLINT> &cols, unsigned char *base, size_t lanes)
+{
+	// staged indicators follow the struct padded to a SQLLEN
+	size_t spare = (layout.row_size + sizeof(SQLLEN) - 1) / sizeof(SQLLEN) * sizeof(SQLLEN);
+	size_t i, lane = 0;
+	SQLLEN *ind;
+
+	for(i=0;i<layout.members.size();++i)
+	{
+		const row_member &m = layout.members[i];
+
+		if(m.indicator != (size_t)-1)
+			ind = (SQLLEN*)(base + m.indicator);
+		else if(lanes)
+		{
+			ind = &_indicators[(lane / lanes * _rowset_size) * lanes + lane % lanes];
+			++lane;
+		}
+		else
+		{
+			ind = (SQLLEN*)(base + spare + lane*sizeof(SQLLEN));
+			++lane;
+		}
+
+		_rc = SQLBindCol(_hstmt, cols[i], m.c_type, base + m.offset, m.width, ind);
+
+		if(!SQL_SUCCEEDED(_rc)) return false;
+	}
+
+	return true;
+}
+
+// binds a buffer per column sized for a full block, rows land
+// column-wise so each column is one contiguous array
+// SQLGetData is only guaranteed after the last bound column and with
+// single row fetches, so binding stops at the first long column
+bool cursor::bind()
+{
+	SQLUSMALLINT col;
+
+	for(_first_unbound=1;_first_unbound<=fields();++_first_unbound)
+		if(_schema->column(_first_unbound).lob) break;
+
+	if(_first_unbound <= fields())
+		_rowset_size = 1;
+
+	_buffers.resize(_first_unbound-1);
+
+	for(col=1;col<_first_unbound;++col)
+	{
+		column_buffer &c = _buffers[col-1];
+
+		c.c_type = _schema->column(col).c_type;
+		c.width = column_width(col, c.c_type);
+		c.data.assign(_rowset_size*c.width, 0);
+		c.indicator.assign(_rowset_size, 0);
+
+		_rc = SQLBindCol(_hstmt, col, c.c_type, &c.data[0], c.width, &c.indicator[0]);
+
+		if(!SQL_SUCCEEDED(_rc))
+		{
+			SQLFreeStmt(_hstmt, SQL_UNBIND);
+			return false;
+		}
+	}
+
+	_row_status.assign(_rowset_size, SQL_ROW_NOROW);
+	_rows_fetched = 0;
+
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_BIND_TYPE, (SQLPOINTER)SQL_BIND_BY_COLUMN, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_STATUS_PTR, &_row_status[0], 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ROWS_FETCHED_PTR, &_rows_fetched, 0);
+	_rc = SQLSetStmtAttr(_hstmt, SQL_ATTR_ROW_ARRAY_SIZE, (SQLPOINTER)_rowset_size, 0);
+
+	// drivers without block cursor support knock the size back
+	// and return SQL_SUCCESS_WITH_INFO, _rows_fetched still holds
+	if(!SQL_SUCCEEDED(_rc))
+	{
+		SQLFreeStmt(_hstmt, SQL_UNBIND);
+		return false;
+	}
+
+	return true;
+}
+
+// rows the driver failed have been counted by count_failed_rows() and
+// are left out
+void cursor::decode(result_set &rs)
+{
+	SQLULEN pos;
+	SQLUSMALLINT col;
+
+	for(pos=0;pos<_rows_fetched;++pos)
+	{
+		if(_row_status[pos] != SQL_ROW_SUCCESS &&
+		   _row_status[pos] != SQL_ROW_SUCCESS_WITH_INFO)
+			continue;
+
+		for(col=1;col<_first_unbound;++col)
+		{
+			column_buffer &c = _buffers[col-1];
+			SQLLEN len = c.indicator[pos];
+			const unsigned char *value = &c.data[pos*c.width];
+
+			if(len == SQL_NULL_DATA)
+			{
+				rs.append_null(col);
+				continue;
+			}
+
+			// truncated values report their full length, so fall back to
+			// the terminated length for text or the buffer width otherwise
+			if(c.c_type == SQL_C_TCHAR)
+			{
+				if(len < 0 || len >= c.width)
+					len = std::char_traits<TCHAR>::length((const TCHAR*)value)*sizeof(TCHAR);
+			}
+			else if(c.c_type != SQL_C_BINARY || len < 0 || len > c.width)
+				len = c.width;
+
+			rs.append(col, value, len);
+		}
+
+		// streamed columns are left on the statement for open_lob()
+		for(col=_first_unbound;col<=fields();++col)
+		{
+			if(_stream_lobs)
+				rs.append_null(col);
+			else
+				read_long(col, rs);
+		}
+
+		rs.end_row();
+	}
+}
+
+// SQLFetch comes back with SQL_SUCCESS_WITH_INFO when rows fail, the
+// records are read once per rowset as anything else on the handle,
+// SQLGetData included, would clear them
+void cursor::count_failed_rows(const TCHAR *fn)
+{
+	SQLULEN pos;
+	unsigned long n = 0;
+
+	for(pos=0;pos<_rows_fetched;++pos)
+	{
+		if(_row_status[pos] != SQL_ROW_SUCCESS &&
+		   _row_status[pos] != SQL_ROW_SUCCESS_WITH_INFO)
+			++n;
+	}
+
+	if(!n) return;
+
+	std::lock_guard<std::mutex> lock(_prefetch_lock);
+
+	odbc::extract_error(fn, _hstmt, SQL_HANDLE_STMT, _failed_diag);
+	_failed_rows += n;
+}
+
+// gathers the value chunk by chunk, the scratch buffer grows to the
+// largest value seen and is kept for the rest of the result set
+void cursor::read_long(SQLUSMALLINT col, result_set &rs)
+{
+	lob_reader r(_hstmt, col, _schema->column(col).c_type);
+	odbc_metrics::clock::time_point start;
+	bool timed = _metrics && _metrics->enabled();
+	size_t used = 0, n, chunks = 0;
+
+	if(_lob_buffer.size() < ODBC_LOB_CHUNK)
+		_lob_buffer.resize(ODBC_LOB_CHUNK);
+
+	if(timed) start = odbc_metrics::clock::now();
+
+	while((n = r.read(&_lob_buffer[used], _lob_buffer.size() - used)) != 0)
+	{
+		used += n;
+		++chunks;
+
+		if(_lob_buffer.size() - used < ODBC_LOB_CHUNK)
+			_lob_buffer.resize(_lob_buffer.size()*2);
+	}
+
+	// the last chunk ends the value without another call
+	// unless the value was NULL or empty
+	if(timed)
+	{
+		_getdata_time += odbc_metrics::clock::now() - start;
+		_getdata_calls += chunks ? chunks : 1;
+	}
+
+	if(r.is_null())
+		rs.append_null(col);
+	else
+		rs.append(col, &_lob_buffer[0], used);
+}
+
+// returns a field_descriptor containing field data
+// queried from the DB
+SQLRETURN cursor::Describe(field_description& c)
+{
+	return SQLDescribeCol(_hstmt,c.colNumber,
+		(SQLTCHAR*)c.colName, sizeof(c.colName), &c.nameLen,
+		&c.dataType, &c.colSize, &c.decimalDigits, &c.nullable);
+}
+
+// fixed types use their struct size, text uses the display size so
+// numbers and dates fit, unbounded columns are capped at ODBC_MAX_BLOCK_WIDTH
+SQLLEN cursor::column_width(SQLUSMALLINT col, SQLSMALLINT c_type)
+{
+	SQLLEN width = 0;
+
+	switch(c_type)
+	{
+		case SQL_C_SBIGINT: return sizeof(SQLBIGINT);
+		case SQL_C_DOUBLE: return sizeof(SQLDOUBLE);
+		case SQL_C_TYPE_DATE: return sizeof(SQL_DATE_STRUCT);
+		case SQL_C_TYPE_TIME: return sizeof(SQL_TIME_STRUCT);
+		case SQL_C_TYPE_TIMESTAMP: return sizeof(SQL_TIMESTAMP_STRUCT);
+		case SQL_C_BINARY:
+			width = (SQLLEN)_schema->column(col).size;
+			if(width <= 0) width = 255;
+			return width > ODBC_MAX_BLOCK_WIDTH ? ODBC_MAX_BLOCK_WIDTH : width;
+	}
+
+	if(_metrics) _metrics->add(metric_driver_calls);
+
+	if(!SQL_SUCCEEDED(SQLColAttribute(_hstmt, col, SQL_DESC_DISPLAY_SIZE, NULL, 0, NULL, &width)) || width <= 0)
+		width = 254;
+
+	if(width > ODBC_MAX_BLOCK_WIDTH)
+		width = ODBC_MAX_BLOCK_WIDTH;
+
+	return (width + 1)*sizeof(SQLTCHAR);
+}
+
+// maps the SQL type of a column to the C type it is stored as, decimals
+// only go native when they are whole numbers that fit a SQLBIGINT, any
+// with a scale stay text as a double can't hold them exactly and would
+// format 12.00 as 12
+SQLSMALLINT cursor::fetch_type(const field_description &c)
+{
+	if(!_typed) return SQL_C_TCHAR;
+
+	switch(c.dataType)
+	{
+		case SQL_BIT:
+		case SQL_TINYINT:
+		case SQL_SMALLINT:
+		case SQL_INTEGER:
+		case SQL_BIGINT:
+			return SQL_C_SBIGINT;
+		case SQL_REAL:
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			return SQL_C_DOUBLE;
+		case SQL_DECIMAL:
+		case SQL_NUMERIC:
+			if(c.decimalDigits == 0 && c.colSize <= 18) return SQL_C_SBIGINT;
+			return SQL_C_TCHAR;
+		case SQL_TYPE_DATE:
+			return SQL_C_TYPE_DATE;
+		case SQL_TYPE_TIME:
+			return SQL_C_TYPE_TIME;
+		case SQL_TYPE_TIMESTAMP:
+			return SQL_C_TYPE_TIMESTAMP;
+		case SQL_BINARY:
+		case SQL_VARBINARY:
+		case SQL_LONGVARBINARY:
+			return SQL_C_BINARY;
+	}
+
+	return SQL_C_TCHAR;
+}
+
+// long types, and text or binary with no size or one over the
+// bind cap, e.g. varchar(max) which reports a size of 0
+bool cursor::is_long(const field_description &c)
+{
+	switch(c.dataType)
+	{
+		case SQL_LONGVARCHAR:
+		case SQL_WLONGVARCHAR:
+		case SQL_LONGVARBINARY:
+			return true;
+		case SQL_CHAR:
+		case SQL_VARCHAR:
+		case SQL_WCHAR:
+		case SQL_WVARCHAR:
+		case SQL_BINARY:
+		case SQL_VARBINARY:
+			return c.colSize == 0 || c.colSize > ODBC_MAX_BLOCK_WIDTH;
+	}
+
+	return false;
+}
@@ -0,0 +1,225 @@
+/*
+  Name: cursor.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Forward-only streaming cursor over an executed statement
+               The result set is described once, the column buffers are
+               bound once and reused for every block, so memory stays
+               constant no matter how many rows are streamed
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef CURSOR_H
+#define CURSOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "result_set.h"
+#include "lob.h"
+#include "metrics.h"
+#include "row_map.h"
+
+// widest column in TCHARs that will be bound for block fetches
+#if !defined(ODBC_MAX_BLOCK_WIDTH)
+    #define ODBC_MAX_BLOCK_WIDTH 4000
+#endif
+
+class cursor
+{
+	public:
+		// default constructor, closed cursor
+		cursor();
+		// unbinds on destruct
+		~cursor();
+
+		// describes the current result set of an executed statement and
+		// binds a block of rowset_size rows, typed fetches columns in
+		// their native C types instead of text
+		// long columns are left unbound and the block drops to a single
+		// row, they are read whole unless stream_lobs leaves them to open_lob()
+		bool open(SQLHANDLE hstmt, SQLULEN rowset_size, bool typed, bool stream_lobs);
+		// unbinds the columns and puts the statement back to single row
+		// fetches, the buffers are kept for the next open
+		void close();
+		// returns whether a result set is open
+		bool is_open();
+
+		// advances to the next row, false once the result set is done
+		bool next();
+		// returns a view of the current row, the view is only valid
+		// until the next block is fetched
+		row_view current();
+		// returns the ID# of the current row, counted from 1 since open
+		unsigned long row_id();
+
+		// opens a chunked reader over a column of the current row when
+		// streaming long columns, every column from the first long one
+		// onwards is left unread and must be opened in ascending order,
+		// the reader is only valid until the next row
+		lob_reader open_lob(SQLUSMALLINT col);
+		lob_reader open_lob(SQLUSMALLINT col, SQLSMALLINT c_type);
+
+		// fetches the next block and appends its rows to rs, which must
+		// have been reset with this cursor's schema, false at the end
+		bool fetch_into(result_set &rs);
+
+		// fetches up to max_rows rows, 0 for all that are left, straight
+		// into rows as layout maps them, binding row-wise so the driver
+		// writes each struct in place, rows failing to fetch are left out
+		// and counted for take_failed_rows()
+		// The cursor must be closed and the columns are only bound for the
+		// call, false at the end of the result set or on a failure, which
+		// leaves the rows fetched before it in rows
+		bool fetch_rows(SQLHANDLE hstmt, SQLULEN rowset_size, const row_layout &layout, row_sink &rows, size_t max_rows);
+		// returns the name of the mapped column that was missing from
+		// the result set when fetch_rows() failed, empty otherwise
+		const TSTR &unmapped_column();
+		// returns the number of rows the driver failed to fetch, which
+		// were left out, since the last call and moves the diagnostics
+		// read when they failed into records
+		unsigned long take_failed_rows(std::vector<diag_record> &records);
+
+		// fetches up to blocks rowsets ahead on a background thread while
+		// the current one is read, 0 turns it off, takes effect on the next
+		// open() and is ignored when streaming long columns, the statement
+		// handle must be left alone while the cursor is open
+		void set_prefetch(size_t blocks);
+		size_t prefetch();
+
+		// records describe and fetch timings, rows and bytes into
+		// metrics, NULL (the default) records nothing
+		void set_metrics(odbc_metrics *metrics);
+
+		// returns the schema of the open result set
+		std::shared_ptr<const result_schema> schema();
+		// returns the number of columns in the open result set
+		SQLUSMALLINT fields();
+		// returns the return code of the last driver call
+		SQLRETURN last_status();
+
+	private:
+		// stores field data as reported by SQLDescribeCol
+        struct field_description
+        {
+            SQLSMALLINT colNumber;
+            SQLTCHAR colName[80];
+            SQLSMALLINT nameLen;
+            SQLSMALLINT dataType;
+            SQLULEN colSize;
+            SQLSMALLINT decimalDigits;
+            SQLSMALLINT nullable;
+        };
+
+		// bound buffer holding one column of a fetched block, width is
+		// in bytes per row and includes the null terminator for text
+        struct column_buffer
+        {
+            SQLSMALLINT c_type;
+            SQLLEN width;
+            std::vector<unsigned char> data;
+            std::vector<SQLLEN> indicator;
+        };
+
+        SQLHANDLE _hstmt;
+        SQLRETURN _rc;
+        std::shared_ptr<result_schema> _schema;
+        std::vector<column_buffer> _buffers;
+        std::vector<SQLUSMALLINT> _row_status;
+
+		// rows per SQLFetch and rows returned by the last one
+        SQLULEN _rowset_size;
+        SQLULEN _rows_fetched;
+
+		// decoded rows of the current block and the position within it
+        result_set _block;
+        size_t _pos;
+        unsigned long _row_id;
+
+		// first column read through SQLGetData instead of being bound
+		// and the scratch buffer whole long values are gathered into
+        SQLUSMALLINT _first_unbound;
+        std::vector<unsigned char> _lob_buffer;
+
+        bool _open;
+        bool _typed;
+        bool _stream_lobs;
+
+		// read-ahead depth and whether the prefetch thread runs for the
+		// open result set, every member below is shared with that thread
+        size_t _prefetch;
+        bool _prefetching;
+        std::thread _prefetcher;
+        std::mutex _prefetch_lock;
+        std::condition_variable _filled_wake;
+        std::condition_variable _spare_wake;
+		// decoded blocks waiting to be read, emptied blocks to reuse
+		// and the block being read while prefetching
+        std::deque<std::unique_ptr<result_set> > _filled;
+        std::vector<std::unique_ptr<result_set> > _spare;
+        std::unique_ptr<result_set> _ahead;
+        bool _prefetch_done;
+        bool _prefetch_stop;
+
+		// indicators of the members fetch_rows() maps without one of their
+		// own, kept in lanes one row stride apart, or the staging block
+		// holding the rows and their indicators when the struct size isn't
+		// a multiple of a SQLLEN, and the column that couldn't be found
+		// by name
+        std::vector<SQLLEN> _indicators;
+        TSTR _unmapped;
+
+		// rows of the fetched rowsets the driver failed and the
+		// diagnostics of their fetches, the prefetch thread counts them
+		// so the records are kept under _prefetch_lock
+        std::atomic<unsigned long> _failed_rows;
+        diag_buffer _failed_diag;
+
+		// where timings go, and the driver time and calls spent in
+		// SQLGetData on the rowset being decoded
+        odbc_metrics *_metrics;
+        odbc_metrics::clock::duration _getdata_time;
+        unsigned long _getdata_calls;
+
+		// fetches the next block from the driver and appends it to rs
+        bool fetch_rowset(result_set &rs);
+		// fills blocks until the result set ends or close() stops it
+        void prefetch_loop();
+		// hands the block being read back to the prefetch thread and
+		// takes the next one, false once the result set is done
+        bool take_block();
+		// stops and joins the prefetch thread
+        void stop_prefetch();
+		// binds every mapped member of the row at base, lanes is the
+		// number of indicator lanes in a row stride, 0 when staging
+        bool bind_rows(const row_layout &layout, const std::vector<SQLUSMALLINT> &cols, unsigned char *base, size_t lanes);
+		// describes every column into a new schema
+        bool describe();
+		// binds a buffer per column sized for a full block
+        bool bind();
+		// appends the rows of the fetched block to rs
+        void decode(result_set &rs);
+		// counts the rows of the last fetch that failed, reading the
+		// diagnostics before the next call on the handle clears them
+        void count_failed_rows(const TCHAR *fn);
+		// reads a whole unbound column of the current row into rs
+        void read_long(SQLUSMALLINT col, result_set &rs);
+		// returns a field_descriptor containing field data
+		// queried from the DB
+        SQLRETURN Describe(field_description& c);
+		// returns the bound buffer width for a column in bytes
+        SQLLEN column_width(SQLUSMALLINT col, SQLSMALLINT c_type);
+		// returns the C type a column is fetched as
+        SQLSMALLINT fetch_type(const field_description &c);
+		// returns whether a column is too long to bind
+        bool is_long(const field_description &c);
+};
+
+
+#endif
@@ -0,0 +1,207 @@
+#include "headers\odbc.h"
+
+/**************
+* DIAG RECORD *
+***************/
+
+TSTR diag_record::to_string() const
+{
+	std::basic_ostringstream<TCHAR> out;
+
+	out << function << _T(": ");
+
+	if(state.empty())
+		out << _T("no diagnostic records");
+	else
+		out << _T("[") << state << _T("] (") << native << _T(") ") << message;
+
+	return out.str();
+}
+
+/**************
+* DIAG BUFFER *
+***************/
+
+void diag_buffer::push(const diag_record &rec)
+{
+	if(_records.size() < ODBC_DIAG_RECORDS)
+	{
+		_records.push_back(rec);
+		return;
+	}
+
+	_records[_next] = rec;
+	_next = (_next + 1) % ODBC_DIAG_RECORDS;
+	++_dropped;
+}
+
+// once the ring has wrapped the oldest record sits at _next
+std::vector<diag_record> diag_buffer::records() const
+{
+	std::vector<diag_record> ret;
+
+	if(_records.size() < ODBC_DIAG_RECORDS)
+		return _records;
+
+	ret.reserve(_records.size());
+	ret.insert(ret.end(), _records.begin() + _next, _records.end());
+	ret.insert(ret.end(), _records.begin(), _records.begin() + _next);
+
+	return ret;
+}
+
+diag_record diag_buffer::last() const
+{
+	if(_records.empty()) return diag_record();
+
+	if(_records.size() < ODBC_DIAG_RECORDS)
+		return _records.back();
+
+	return _records[(_next + ODBC_DIAG_RECORDS - 1) % ODBC_DIAG_RECORDS];
+}
+
+void diag_buffer::clear()
+{
+	_records.clear();
+	_next = 0;
+	_dropped = 0;
+}
+
+/***********
+* LOG SINK *
+************/
+
+// the default sink is only created when the first record is logged, so
+// a program that never hits an error never starts the writer thread
+struct log_sink_registry
+{
+	log_sink_registry() : set(false) {}
+
+	std::mutex lock;
+	std::shared_ptr<log_sink> sink;
+	bool set;
+};
+
+static log_sink_registry &sink_registry()
+{
+	static log_sink_registry registry;
+
+	return registry;
+}
+
+void log_sink::set_default(std::shared_ptr<log_sink> sink)
+{
+	log_sink_registry &r = sink_registry();
+	std::lock_guard<std::mutex> lock(r.lock);
+
+	r.sink = sink;
+	r.set = true;
+}
+
+std::shared_ptr<log_sink> log_sink::current()
+{
+	log_sink_registry &r = sink_registry();
+	std::lock_guard<std::mutex> lock(r.lock);
+
+	if(!r.set)
+	{
+		r.sink.reset(new async_log_sink(std::shared_ptr<log_sink>(new stderr_log_sink())));
+		r.set = true;
+	}
+
+	return r.sink;
+}
+
+void stderr_log_sink::write(const diag_record &rec)
+{
+	FTPRINTF(stderr, _T("%s\n"), rec.to_string().c_str());
+}
+
+/*****************
+* ASYNC LOG SINK *
+******************/
+
+async_log_sink::async_log_sink(std::shared_ptr<log_sink> target)
+	: _target(target)
+{
+	_writing = 0;
+	_dropped = 0;
+	_stop = false;
+
+	_writer = std::thread(&async_log_sink::write_loop, this);
+}
+
+async_log_sink::~async_log_sink()
+{
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_stop = true;
+	}
+
+	_queued.notify_all();
+	_writer.join();
+}
+
+void async_log_sink::write(const diag_record &rec)
+{
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+
+		if(_queue.size() >= ODBC_LOG_QUEUE)
+		{
+			++_dropped;
+			return;
+		}
+
+		_queue.push_back(rec);
+	}
+
+	_queued.notify_one();
+}
+
+void async_log_sink::flush()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+
+	_drained.wait(lock, [this]{ return _queue.empty() && !_writing; });
+}
+
+unsigned long async_log_sink::dropped()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _dropped;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// the whole queue is taken at once so the lock isn't held while writing,
+// whatever is still queued on stop is written before the thread ends
+void async_log_sink::write_loop()
+{
+	std::deque<diag_record> batch;
+	std::deque<diag_record>::iterator itr;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(_lock);
+			_writing = 0;
+			_drained.notify_all();
+
+			_queued.wait(lock, [this]{ return _stop || !_queue.empty(); });
+
+			if(_queue.empty()) break;
+
+			batch.swap(_queue);
+			_writing = batch.size();
+		}
+
+		for(itr=batch.begin();itr!=batch.end();++itr)
+			if(_target) _target->write(*itr);
+
+		batch.clear();
+	}
+}
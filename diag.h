@@ -0,0 +1,142 @@
+/*
+  Name: diag.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Diagnostic records collected from failed driver calls
+               Each handle owner keeps its most recent records in a
+               bounded buffer, and every record is also handed to a log
+               sink that writes it out on its own thread so the failing
+               call never waits on console or file I/O
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef DIAG_H
+#define DIAG_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// diagnostic records each statement and connection keeps
+#if !defined(ODBC_DIAG_RECORDS)
+    #define ODBC_DIAG_RECORDS 32
+#endif
+
+// records the async log sink holds before it starts dropping them
+#if !defined(ODBC_LOG_QUEUE)
+    #define ODBC_LOG_QUEUE 4096
+#endif
+
+// one record as returned by SQLGetDiagRec, function names the wrapper
+// method that failed and record the position among its records from 1
+struct diag_record
+{
+	TSTR function;
+	TSTR state;
+	SQLINTEGER native = 0;
+	TSTR message;
+	SQLSMALLINT record = 0;
+	std::chrono::system_clock::time_point time;
+
+	// formats as "function: [SQLSTATE] (native) message"
+	TSTR to_string() const;
+};
+
+// Ring of the most recent records, older ones are overwritten
+class diag_buffer
+{
+	public:
+		diag_buffer() : _next(0), _dropped(0) {}
+
+		// adds a record, overwriting the oldest once full
+		void push(const diag_record &rec);
+		// returns the records held, oldest first
+		std::vector<diag_record> records() const;
+		// returns the newest record, empty when there are none
+		diag_record last() const;
+
+		size_t size() const { return _records.size(); }
+		bool empty() const { return _records.empty(); }
+		// returns the number of records overwritten since the last clear()
+		unsigned long dropped() const { return _dropped; }
+
+		void clear();
+
+	private:
+		std::vector<diag_record> _records;
+		// slot the next record goes into once the ring is full
+		size_t _next;
+		unsigned long _dropped;
+};
+
+// Where diagnostic records are logged, write() is called from the
+// failing call's thread so implementations must not block on I/O,
+// wrap a blocking sink in async_log_sink instead
+class log_sink
+{
+	public:
+		virtual ~log_sink() {}
+
+		virtual void write(const diag_record &rec) = 0;
+
+		// sink every connection logs to, an async_log_sink over
+		// stderr_log_sink until replaced, NULL turns logging off
+		static void set_default(std::shared_ptr<log_sink> sink);
+		static std::shared_ptr<log_sink> current();
+};
+
+// Writes each record as a line on stderr, blocks, so it is
+// normally used through async_log_sink
+class stderr_log_sink : public log_sink
+{
+	public:
+		void write(const diag_record &rec);
+};
+
+// Queues records for a background thread that passes them on to the
+// wrapped sink, once ODBC_LOG_QUEUE records are waiting new ones are
+// dropped and counted rather than holding up the caller
+class async_log_sink : public log_sink
+{
+	public:
+		// starts the thread that feeds target
+		async_log_sink(std::shared_ptr<log_sink> target);
+		// writes everything still queued, then joins
+		~async_log_sink();
+
+		async_log_sink(const async_log_sink&) = delete;
+		async_log_sink &operator=(const async_log_sink&) = delete;
+
+		void write(const diag_record &rec);
+
+		// waits until every record queued so far has been written
+		void flush();
+		// returns the number of records dropped on a full queue
+		unsigned long dropped();
+
+	private:
+		std::shared_ptr<log_sink> _target;
+
+		std::mutex _lock;
+		std::condition_variable _queued;
+		std::condition_variable _drained;
+		std::deque<diag_record> _queue;
+		// records taken off the queue but not written yet
+		size_t _writing;
+		unsigned long _dropped;
+		bool _stop;
+
+		std::thread _writer;
+
+		void write_loop();
+};
+
+
+#endif
@@ -0,0 +1,112 @@
+#include "headers\odbc.h"
+
+/*************
+* LOB READER *
+**************/
+
+lob_reader::lob_reader()
+{
+	_hstmt = NULL;
+	_col = 0;
+	_c_type = SQL_C_BINARY;
+	_rc = SQL_NO_DATA;
+	_eof = true;
+	_null = false;
+}
+
+lob_reader::lob_reader(SQLHANDLE hstmt, SQLUSMALLINT col, SQLSMALLINT c_type)
+{
+	_hstmt = hstmt;
+	_col = col;
+	_c_type = c_type;
+	_rc = SQL_SUCCESS;
+	_eof = !hstmt;
+	_null = false;
+}
+
+// text chunks come back null terminated, so the usable part of buf is one
+// character shorter and only whole characters are counted
+size_t lob_reader::read(void *buf, size_t len)
+{
+	size_t unit = (_c_type == SQL_C_WCHAR) ? sizeof(SQLWCHAR) : (_c_type == SQL_C_CHAR) ? sizeof(SQLCHAR) : 0;
+	size_t avail;
+	SQLLEN ind = 0;
+
+	if(_eof || len <= unit) return 0;
+
+	avail = unit ? ((len - unit) / unit) * unit : len;
+
+	_rc = SQLGetData(_hstmt, _col, _c_type, buf, (SQLLEN)(avail + unit), &ind);
+
+	if(_rc == SQL_NO_DATA || !SQL_SUCCEEDED(_rc))
+	{
+		_eof = true;
+		return 0;
+	}
+
+	if(ind == SQL_NULL_DATA)
+	{
+		_null = true;
+		_eof = true;
+		return 0;
+	}
+
+	// truncated, there is more to come on the next call
+	if(_rc == SQL_SUCCESS_WITH_INFO && (ind == SQL_NO_TOTAL || ind > (SQLLEN)avail))
+		return avail;
+
+	_eof = true;
+	return (ind > (SQLLEN)avail) ? avail : (size_t)ind;
+}
+
+bool lob_reader::eof()
+{
+	return _eof;
+}
+
+bool lob_reader::is_null()
+{
+	return _null;
+}
+
+SQLRETURN lob_reader::last_status()
+{
+	return _rc;
+}
+
+/****************
+* LOB STREAMBUF *
+*****************/
+
+lob_streambuf::lob_streambuf(const lob_reader &reader, size_t chunk_size)
+	: _reader(reader), _buffer(chunk_size ? chunk_size : ODBC_LOB_CHUNK)
+{
+	setg(&_buffer[0], &_buffer[0], &_buffer[0]);
+}
+
+lob_streambuf::int_type lob_streambuf::underflow()
+{
+	size_t n;
+
+	if(gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+	n = _reader.read(&_buffer[0], _buffer.size());
+	if(!n) return traits_type::eof();
+
+	setg(&_buffer[0], &_buffer[0], &_buffer[0] + n);
+	return traits_type::to_int_type(*gptr());
+}
+
+/**************
+* LOB ISTREAM *
+***************/
+
+lob_istream::lob_istream(const lob_reader &reader)
+	: std::istream(&_buf), _buf(reader, ODBC_LOB_CHUNK)
+{
+}
+
+lob_istream::lob_istream(const lob_reader &reader, size_t chunk_size)
+	: std::istream(&_buf), _buf(reader, chunk_size)
+{
+}
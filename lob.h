@@ -0,0 +1,82 @@
+/*
+  Name: lob.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Chunked readers for long text and binary columns
+               Values are pulled through repeated SQLGetData calls so
+               documents of any size can be piped on with bounded memory
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef LOB_H
+#define LOB_H
+
+#include <istream>
+#include <streambuf>
+#include <vector>
+
+// default chunk size in bytes for long column reads
+#if !defined(ODBC_LOB_CHUNK)
+    #define ODBC_LOB_CHUNK 65536
+#endif
+
+// Reads a single column of the current row a chunk at a time, the
+// statement must stay on that row until the reader is done with it
+class lob_reader
+{
+	public:
+		// default constructor, reads nothing
+		lob_reader();
+		// reads column col of hstmt converted to c_type, SQL_C_BINARY
+		// gives raw bytes, SQL_C_CHAR and SQL_C_WCHAR give text
+		lob_reader(SQLHANDLE hstmt, SQLUSMALLINT col, SQLSMALLINT c_type);
+
+		// reads up to len bytes of the value into buf and returns how many
+		// were read, 0 once the value is exhausted, text is never terminated
+		size_t read(void *buf, size_t len);
+
+		// returns whether the whole value has been read
+		bool eof();
+		// returns whether the value was NULL
+		bool is_null();
+		// returns the return code of the last SQLGetData
+		SQLRETURN last_status();
+
+	private:
+		SQLHANDLE _hstmt;
+		SQLUSMALLINT _col;
+		SQLSMALLINT _c_type;
+		SQLRETURN _rc;
+		bool _eof;
+		bool _null;
+};
+
+// Stream buffer refilled from a lob_reader one chunk at a time
+class lob_streambuf : public std::streambuf
+{
+	public:
+		lob_streambuf(const lob_reader &reader, size_t chunk_size);
+
+	protected:
+		int_type underflow();
+
+	private:
+		lob_reader _reader;
+		std::vector<char> _buffer;
+};
+
+// Input stream over a long column, e.g. file << lob_istream(db.open_lob(3)).rdbuf()
+class lob_istream : public std::istream
+{
+	public:
+		lob_istream(const lob_reader &reader);
+		lob_istream(const lob_reader &reader, size_t chunk_size);
+
+	private:
+		lob_streambuf _buf;
+};
+
+
+#endif
@@ -0,0 +1,316 @@
+/*
+  Name: metrics.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Latency histograms and counters for the statements run on
+               a connection, read back as a snapshot that can be written
+               out as a metrics file
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+// define ODBC_NO_METRICS to compile the instrumentation out altogether,
+// the API stays in place and every snapshot comes back empty
+#if !defined(ODBC_NO_METRICS)
+    #define ODBC_METRICS
+#endif
+
+// number of latency buckets, bucket i counts calls that took under 2^i
+// nanoseconds and the last one everything slower, 48 reaches past a day
+#if !defined(ODBC_METRICS_BUCKETS)
+    #define ODBC_METRICS_BUCKETS 48
+#endif
+
+// timed phases, fetch is the driver's share of a rowset (SQLFetch and
+// SQLGetData) and decode is the rest, copying it into the result set
+enum metric_timer
+{
+    metric_prepare,
+    metric_execute,
+    metric_fetch,
+    metric_decode,
+    metric_describe,
+    metric_timers
+};
+
+enum metric_counter
+{
+    metric_rows,
+    metric_bytes,
+    metric_driver_calls,
+    metric_reconnects,
+    metric_errors,
+    metric_counters
+};
+
+// copy of one latency histogram, times are in nanoseconds
+struct histogram_snapshot
+{
+    unsigned long long count;
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    unsigned long long buckets[ODBC_METRICS_BUCKETS];
+
+    // returns the upper bound of the bucket holding fraction p of the
+    // calls, e.g. 0.99, exact to within a factor of 2
+    unsigned long long percentile(double p) const
+    {
+        unsigned long long seen = 0, want;
+
+        if(!count) return 0;
+
+        want = (unsigned long long)(p * count + 0.5);
+        if(want < 1) want = 1;
+
+        for(int i=0;i<ODBC_METRICS_BUCKETS-1;++i)
+        {
+            seen += buckets[i];
+            if(seen >= want) return std::min(1ULL << i, max_ns);
+        }
+
+        return max_ns;
+    }
+
+    double mean_ns() const { return count ? (double)total_ns / count : 0; }
+};
+
+// everything recorded on a connection at one point in time
+struct metrics_snapshot
+{
+    histogram_snapshot timers[metric_timers];
+    unsigned long long counters[metric_counters];
+
+    static const char *timer_name(int timer)
+    {
+        static const char *names[metric_timers] = { "prepare", "execute", "fetch", "decode", "describe" };
+
+        return names[timer];
+    }
+
+    static const char *counter_name(int counter)
+    {
+        static const char *names[metric_counters] = { "rows", "bytes", "driver_calls", "reconnects", "errors" };
+
+        return names[counter];
+    }
+
+    // writes the Prometheus text format, latencies as histograms in
+    // seconds with every bucket that has been reached
+    void write(std::ostream &out) const
+    {
+        char le[32];
+        int t, c, i, last;
+
+        for(t=0;t<metric_timers;++t)
+        {
+            const histogram_snapshot &h = timers[t];
+            unsigned long long seen = 0;
+
+            out << "# TYPE odbc_" << timer_name(t) << "_seconds histogram\n";
+
+            for(last=ODBC_METRICS_BUCKETS-2;last>0 && !h.buckets[last];--last);
+
+            for(i=0;i<=last;++i)
+            {
+                seen += h.buckets[i];
+                snprintf(le, sizeof(le), "%.9g", (double)(1ULL << i) / 1e9);
+                out << "odbc_" << timer_name(t) << "_seconds_bucket{le=\"" << le << "\"} " << seen << "\n";
+            }
+
+            snprintf(le, sizeof(le), "%.9f", (double)h.total_ns / 1e9);
+            out << "odbc_" << timer_name(t) << "_seconds_bucket{le=\"+Inf\"} " << h.count << "\n";
+            out << "odbc_" << timer_name(t) << "_seconds_sum " << le << "\n";
+            out << "odbc_" << timer_name(t) << "_seconds_count " << h.count << "\n";
+        }
+
+        for(c=0;c<metric_counters;++c)
+        {
+            out << "# TYPE odbc_" << counter_name(c) << "_total counter\n";
+            out << "odbc_" << counter_name(c) << "_total " << counters[c] << "\n";
+        }
+    }
+
+    // writes to a temporary file first and renames it over path so
+    // a collector reading the file never sees half of it
+    bool dump(const TSTR &path) const
+    {
+        TSTR tmp = path + _T(".tmp");
+
+        {
+            std::ofstream out(tmp.c_str(), std::ios::out | std::ios::trunc);
+
+            if(!out) return false;
+
+            write(out);
+            out.flush();
+
+            if(!out) return false;
+        }
+
+#if defined(UNICODE) || defined(_UNICODE_)
+        if(_wrename(tmp.c_str(), path.c_str()) == 0) return true;
+        _wremove(path.c_str());
+        return _wrename(tmp.c_str(), path.c_str()) == 0;
+#else
+        // rename() won't replace an existing file on Windows
+        if(rename(tmp.c_str(), path.c_str()) == 0) return true;
+        remove(path.c_str());
+        return rename(tmp.c_str(), path.c_str()) == 0;
+#endif
+    }
+};
+
+// Shared by every statement on a connection and safe to record into
+// from the prefetch and async threads, while disabled each hook costs
+// a relaxed load and a branch, with ODBC_NO_METRICS nothing at all
+class odbc_metrics
+{
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        odbc_metrics() { _enabled = false; reset(); }
+
+        odbc_metrics(const odbc_metrics&) = delete;
+        odbc_metrics &operator=(const odbc_metrics&) = delete;
+
+        // turns recording on or off, what has been recorded is kept
+        void set_enabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+
+        bool enabled() const
+        {
+#if defined(ODBC_METRICS)
+            return _enabled.load(std::memory_order_relaxed);
+#else
+            return false;
+#endif
+        }
+
+        // adds one call of length elapsed to a histogram
+        void record(metric_timer timer, clock::duration elapsed)
+        {
+            unsigned long long ns = (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            unsigned long long max;
+            int bucket = 0;
+
+            if(!enabled()) return;
+
+            histogram &h = _timers[timer];
+
+            while(bucket < ODBC_METRICS_BUCKETS-1 && (ns >> bucket)) ++bucket;
+
+            h.count.fetch_add(1, std::memory_order_relaxed);
+            h.total_ns.fetch_add(ns, std::memory_order_relaxed);
+            h.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+
+            max = h.max_ns.load(std::memory_order_relaxed);
+            while(ns > max && !h.max_ns.compare_exchange_weak(max, ns, std::memory_order_relaxed));
+        }
+
+        void add(metric_counter counter, unsigned long long n = 1)
+        {
+            if(enabled()) _counters[counter].fetch_add(n, std::memory_order_relaxed);
+        }
+
+        // copies every histogram and counter, values recorded while the
+        // copy is taken may be only partly included
+        metrics_snapshot snapshot() const
+        {
+            metrics_snapshot s;
+            int t, c, i;
+
+            for(t=0;t<metric_timers;++t)
+            {
+                s.timers[t].count = _timers[t].count.load(std::memory_order_relaxed);
+                s.timers[t].total_ns = _timers[t].total_ns.load(std::memory_order_relaxed);
+                s.timers[t].max_ns = _timers[t].max_ns.load(std::memory_order_relaxed);
+
+                for(i=0;i<ODBC_METRICS_BUCKETS;++i)
+                    s.timers[t].buckets[i] = _timers[t].buckets[i].load(std::memory_order_relaxed);
+            }
+
+            for(c=0;c<metric_counters;++c)
+                s.counters[c] = _counters[c].load(std::memory_order_relaxed);
+
+            return s;
+        }
+
+        // zeroes every histogram and counter
+        void reset()
+        {
+            int t, c, i;
+
+            for(t=0;t<metric_timers;++t)
+            {
+                _timers[t].count = 0;
+                _timers[t].total_ns = 0;
+                _timers[t].max_ns = 0;
+
+                for(i=0;i<ODBC_METRICS_BUCKETS;++i)
+                    _timers[t].buckets[i] = 0;
+            }
+
+            for(c=0;c<metric_counters;++c)
+                _counters[c] = 0;
+        }
+
+    private:
+        struct histogram
+        {
+            std::atomic<unsigned long long> count;
+            std::atomic<unsigned long long> total_ns;
+            std::atomic<unsigned long long> max_ns;
+            std::atomic<unsigned long long> buckets[ODBC_METRICS_BUCKETS];
+        };
+
+        std::atomic<bool> _enabled;
+        histogram _timers[metric_timers];
+        std::atomic<unsigned long long> _counters[metric_counters];
+};
+
+// Times the scope it lives in into one of the histograms, the clock is
+// only read when metrics is enabled, metrics may be NULL
+class metrics_timer
+{
+    public:
+        metrics_timer(odbc_metrics *metrics, metric_timer timer)
+        {
+            _metrics = (metrics && metrics->enabled()) ? metrics : NULL;
+            _timer = timer;
+
+            if(_metrics) _start = odbc_metrics::clock::now();
+        }
+
+        ~metrics_timer() { stop(); }
+
+        metrics_timer(const metrics_timer&) = delete;
+        metrics_timer &operator=(const metrics_timer&) = delete;
+
+        // records the time so far, later calls do nothing
+        void stop()
+        {
+            if(!_metrics) return;
+
+            _metrics->record(_timer, odbc_metrics::clock::now() - _start);
+            _metrics = NULL;
+        }
+
+    private:
+        odbc_metrics *_metrics;
+        metric_timer _timer;
+        odbc_metrics::clock::time_point _start;
+};
+
+
+#endif
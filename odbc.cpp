@@ -9,6 +9,11 @@ odbc::odbc()
 	_dsn.clear();
 	_uid.clear();
 	_pwd.clear();
+	_rowset_size = 1;
+	_typed = false;
+	_stream_lobs = false;
+	_prefetch = 0;
+	_memory_budget = 0;
 
 	init();
 }
@@ -18,6 +23,11 @@ odbc::odbc(TSTR dsn)
 	_dsn = dsn;
 	_uid.clear();
 	_pwd.clear();
+	_rowset_size = 1;
+	_typed = false;
+	_stream_lobs = false;
+	_prefetch = 0;
+	_memory_budget = 0;
 
 	init();
 }
@@ -27,6 +37,11 @@ odbc::odbc(TSTR dsn, TSTR uid, TSTR pwd)
 	_dsn = dsn;
 	_uid = uid;
 	_pwd = pwd;
+	_rowset_size = 1;
+	_typed = false;
+	_stream_lobs = false;
+	_prefetch = 0;
+	_memory_budget = 0;
 
 	init();
 }
@@ -34,7 +49,13 @@ odbc::odbc(TSTR dsn, TSTR uid, TSTR pwd)
 //**
 odbc::~odbc()
 {
+	std::vector<statement*>::iterator itr;
+
 	disconnect();
+
+	// statements outliving the connection have nothing to go back to
+	for(itr=_statements.begin();itr!=_statements.end();++itr)
+		(*itr)->_owner = NULL;
 }
 
 void odbc::set_connector(TSTR dsn)
@@ -68,22 +89,32 @@ bool odbc::connect()
 		if(_init && _henv && _hdbc)
 		{
 		    if(_uid!=TSTR())
+		    {
 		        _rc = SQLConnect(_hdbc, (SQLTCHAR*)_dsn.c_str(), SQL_NTS,
                                         (SQLTCHAR*)_uid.c_str(), SQL_NTS,
                                         (SQLTCHAR*)_pwd.c_str(), SQL_NTS);
+		    }
 		    else
+		    {
 		        _rc = SQLConnect(_hdbc, (SQLTCHAR*)_dsn.c_str(), SQL_NTS, NULL, 0, NULL, 0);
+		    }
+
+			_metrics.add(metric_driver_calls);
 
 			if(!SQL_SUCCEEDED(_rc))
 			{
-				extract_error(_T("connect()"),_hdbc, SQL_HANDLE_DBC);
+				_metrics.add(metric_errors);
+				_err = extract_error(_T("connect()"),_hdbc, SQL_HANDLE_DBC, _diag).to_string();
 				SQLFreeHandle(SQL_HANDLE_ENV, _henv);
 				SQLFreeHandle(SQL_HANDLE_DBC,_hdbc);
 				return false;
 			}
 
-            _rc = SQLAllocStmt(_hdbc, &_hstmt);
-			_connected = SQL_SUCCEEDED(_rc);
+			_connected = true;
+			_connected = _stmt.attach(*this);
+			_rc = _stmt.last_status();
+
+			if(_connected) attach_statements();
 		}
 		else
 			_rc = SQL_ERROR;
@@ -104,12 +135,11 @@ bool odbc::disconnect()
 	{
 		if(_connected)
 		{
-			_rc = SQLFreeStmt(_hstmt, SQL_DROP);
+			detach_statements();
 			_rc = SQLDisconnect(_hdbc);
 			_rc = SQLFreeHandle(SQL_HANDLE_DBC,_hdbc);
 			_rc = SQLFreeHandle(SQL_HANDLE_ENV,_henv);
 
-			_hstmt = NULL;
 			_hdbc = NULL;
 			_henv = NULL;
 
@@ -133,6 +163,35 @@ bool odbc::connection_status()
 	return _connected;
 }
 
+// drivers that do not track the attribute are taken as alive
+bool odbc::is_alive()
+{
+	SQLUINTEGER dead = SQL_CD_FALSE;
+
+	if(!_connected) return false;
+
+	_rc = SQLGetConnectAttr(_hdbc, SQL_ATTR_CONNECTION_DEAD, &dead, 0, NULL);
+
+	if(!SQL_SUCCEEDED(_rc)) return true;
+
+	return dead == SQL_CD_FALSE;
+}
+
+SQLUINTEGER odbc::async_mode()
+{
+	if(!_connected) return SQL_AM_NONE;
+
+	if(!_async_known)
+	{
+		if(!SQL_SUCCEEDED(SQLGetInfo(_hdbc, SQL_ASYNC_MODE, &_async_mode, sizeof(_async_mode), NULL)))
+			_async_mode = SQL_AM_NONE;
+
+		_async_known = true;
+	}
+
+	return _async_mode;
+}
+
 SQLRETURN odbc::last_status()
 {
 	return _rc;
@@ -143,6 +202,36 @@ TSTR odbc::last_error()
 	return _err;
 }
 
+TSTR odbc::last_state()
+{
+	diag_record conn = _diag.last(), stmt = _stmt._diag.last();
+
+	return (stmt.time > conn.time) ? stmt.state : conn.state;
+}
+
+// both buffers are already in order, so a merge by time keeps them that way
+std::vector<diag_record> odbc::diagnostics()
+{
+	std::vector<diag_record> conn = _diag.records(), stmt = _stmt._diag.records(), ret;
+
+	ret.reserve(conn.size() + stmt.size());
+	std::merge(conn.begin(), conn.end(), stmt.begin(), stmt.end(), std::back_inserter(ret),
+			   [](const diag_record &a, const diag_record &b){ return a.time < b.time; });
+
+	return ret;
+}
+
+void odbc::clear_diagnostics()
+{
+	_diag.clear();
+	_stmt._diag.clear();
+}
+
+void odbc::set_log_sink(std::shared_ptr<log_sink> sink)
+{
+	log_sink::set_default(sink);
+}
+
 // returns odbc formatted connection string on successful connection
 TSTR odbc::connection_string()
 {
@@ -170,314 +259,173 @@ TSTR odbc::connection_string()
 }
 
 
-// prepares the statement and then loops through a vector of params
-// and binds each param in the vector, important to note that the
-// number of params defined must all be bound
-bool odbc::prepare_and_bind(TSTR sql_stmt,std::vector<param> params)
+void odbc::free_session()
 {
-	bool ret;
-	std::vector<param>::iterator it;
-
-	try
-	{
-		if(prepare(sql_stmt))
-		{
-			it=params.begin();
-
-			while(it!=params.end())
-			{
-				ret = bind_param(it->col, it->val, it->type, it->size, it->decimals);
-				++it;
-			}
+	free_link();
+	init();
+}
 
-			return ret;
-		}
-		else
-            return false;
-	}
-	catch(_com_error &e)
-	{
-		_err = _T("_com_error: ") + e.Error();
-	}
+// the query methods all run on the default statement,
+// see statement.cpp for how each one works
 
-	return false;
+bool odbc::prepare_and_bind(TSTR sql_stmt,std::vector<param> params)
+{
+	return statement_status(_stmt.prepare_and_bind(sql_stmt, params));
 }
 
-// Prepares the statement and if successful stores the SQL statement for re-use and for binding
 bool odbc::prepare(TSTR sql_stmt)
 {
-	try
-	{
-		if(_connected)
-		{
-			_rc = SQLPrepare(_hstmt, (SQLTCHAR*)sql_stmt.c_str(), sql_stmt.size());
-
-			if(!SQL_SUCCEEDED(_rc))
-			{
-				_err = _T("Failed to prepare statement with SQL error");
-				extract_error(_T("prepare()"),_hstmt, SQL_HANDLE_STMT);
-				return false;
-			}
-			else
-			{
-				_sql_stmt = sql_stmt;
-				return true;
-			}
-		}
-		else
-		{
-			_err = _T("Failed to prepare statement, connection hasn't been established yet");
-			return false;
-		}
-	}
-	catch(_com_error &e)
-	{
-		_err = _T("_com_error: ") + e.Error();
-	}
-
-	return false;
+	return statement_status(_stmt.prepare(sql_stmt));
 }
 
-// Binds a parameter to a prepared SQL statement
 bool odbc::bind_param(short col, TSTR val, short sql_field_type, SQLULEN col_size ,short decimal_pts)
 {
-	try
-	{
-		if(_connected && _sql_stmt.size())
-		{
-			TCHAR* cval = new TCHAR[val.size()+1];
-			strcpy(cval,val.c_str());
+	return statement_status(_stmt.bind_param(col, val, sql_field_type, col_size, decimal_pts));
+}
 
-			_rc = SQLBindParameter(_hstmt,col,SQL_PARAM_INPUT,SQL_C_CHAR,sql_field_type,
-								   col_size,decimal_pts, cval, val.length(), NULL);
-			if(!SQL_SUCCEEDED(_rc))
-			{
-				extract_error(_T("bind_param()"),_hstmt, SQL_HANDLE_STMT);
-				_err = _T("Unable to bind PARAM: ") + val;
-				_bound = false;
-				return false;
-			}
-			else
-			{
-				_bound = true;
-				return true;
-			}
-		}
+bool odbc::execute_batch(std::vector<param_array> &params)
+{
+	return statement_status(_stmt.execute_batch(params));
+}
 
-	}
-	catch(_com_error &e)
-	{
-		_err = _T("_com_error: ") + e.Error();
-	}
+bool odbc::execute_batch(std::vector<param_binding> &bindings, SQLULEN row_size, SQLULEN sets)
+{
+	return statement_status(_stmt.execute_batch(bindings, row_size, sets));
+}
 
-	return false;
+std::vector<SQLUSMALLINT> odbc::batch_status()
+{
+	return _stmt.batch_status();
 }
 
-void odbc::free_session()
+SQLULEN odbc::batch_processed()
 {
-	free_link();
-	init();
+	return _stmt.batch_processed();
 }
 
+// a handle that can't be reallocated means the connection
+// has gone, so the session is rebuilt and reconnected
 void odbc::free_statement()
 {
-    _fields = 0;
-    _rows = 0;
-
-    field_info.erase(field_info.begin(),field_info.end());
-    field_names.erase(field_names.begin(),field_names.end());
-	_table.erase(_table.begin(),_table.end());
-
-	if(_hstmt) _rc = SQLFreeStmt(_hstmt, SQL_DROP);
-
-	_rc = SQLAllocStmt(_hdbc, &_hstmt);
+	_stmt.free_statement();
+	_rc = _stmt.last_status();
 
-	if(SQL_SUCCEEDED(_rc))
-	{
-        _sql_stmt.clear();
-        _bound = false;
-        _built = false;
-        _executed = false;
-	}
-	else
+	if(!SQL_SUCCEEDED(_rc))
 	{
+	    _metrics.add(metric_reconnects);
 	    free_session();
 	    connect();
 	}
 }
 
-// executes a prepared and bound statement
 bool odbc::execute()
 {
-	try
-	{
-		if(_connected)
-		{
-			_rc = SQLExecute(_hstmt);
-
-			if(!SQL_SUCCEEDED(_rc))
-			{
-				extract_error(_T("execute()"),_hstmt, SQL_HANDLE_STMT);
-				return false;
-			}
-
-			_built = false;
-			_executed = true;
-			return true;
-		}
-	}
-	catch(_com_error &e)
-	{
-		_err = _T("_com_error: ") + e.Error();
-	}
-
-	return false;
+	return statement_status(_stmt.execute());
 }
 
 bool odbc::execute_direct(TSTR sql_stmt)
 {
-	try
-	{
-		if(_connected)
-		{
-			_rc = SQLExecDirect(_hstmt,(SQLTCHAR*)sql_stmt.c_str(), SQL_NTS);
+	return statement_status(_stmt.execute_direct(sql_stmt));
+}
 
-			if(!SQL_SUCCEEDED(_rc))
-			{
-				extract_error(_T("execute_direct()"),_hstmt, SQL_HANDLE_STMT);
-				return false;
-			}
+std::future<bool> odbc::execute_async()
+{
+	return _stmt.execute_async();
+}
 
-			_built = false;
-			_executed = true;
-			return true;
-		}
-	}
-	catch(_com_error &e)
-	{
-		_err = _T("_com_error: ") + e.Error();
-	}
+std::future<bool> odbc::execute_direct_async(TSTR sql_stmt)
+{
+	return _stmt.execute_direct_async(sql_stmt);
+}
 
-	return false;
+std::future<const result_set&> odbc::results_async()
+{
+	return _stmt.results_async();
 }
 
-// keeps returning each row of a built result set table until
-// the internal pointer reaches the end
 bool odbc::fetch(unordered_row &r)
 {
-	if(!_built) {build_result_set();} else if(!_fetching) {reset_iterator();}
+	return _stmt.fetch(r);
+}
 
-	if(_itr!=_table.end())
-    {
-        _fetching = true;
-        r = _itr->second;
-        ++_itr;
-    }
-    else
-    {
-        _itr = _table.begin();
-        _fetching = false;
-        return false;
-    }
+bool odbc::fetch(unordered_row *&r)
+{
+	return _stmt.fetch(r);
+}
 
-    return true;
+bool odbc::fetch(row_view &r)
+{
+	return _stmt.fetch(r);
 }
 
+unordered_row odbc::fetch_row(unsigned long row_id)
+{
+	return _stmt.fetch_row(row_id);
+}
 
-bool odbc::fetch(unordered_row *&r)
+bool odbc::fetch_row(unsigned long row_id, row_view &r)
 {
-	if(!_built) {build_result_set();} else if(!_fetching) {reset_iterator();}
+	return _stmt.fetch_row(row_id, r);
+}
 
-	if(_itr!=_table.end())
-    {
-        _fetching = true;
-        r = &(_itr->second);
-        ++_itr;
-    }
-    else
-    {
-        _itr = _table.begin();
-        _fetching = false;
-        return false;
-    }
+const result_set &odbc::results()
+{
+	return _stmt.results();
+}
 
-    return true;
+bool odbc::fetch_direct(unordered_row &r)
+{
+	return _stmt.fetch_direct(r);
 }
 
+bool odbc::fetch_direct(row_view &r)
+{
+	return _stmt.fetch_direct(r);
+}
 
-// returns only a single row from the result set
-unordered_row odbc::fetch_row(unsigned long row_id)
+bool odbc::fetch_block(result_set &block)
 {
-	if(!_built) build_result_set();
-	unordered_row r(0);
+	return _stmt.fetch_block(block);
+}
 
-	if(_table.size() && row_id >= 1 && row_id <= _table.size())
-	    return _table.find(row_id)->second;
+bool odbc::execute_cached(TSTR sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+						  const std::vector<TSTR> &tags)
+{
+	return statement_status(_stmt.execute_cached(sql_stmt, results, ttl, tags));
+}
 
-	return r;
+bool odbc::execute_cached(std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+						  const std::vector<TSTR> &tags)
+{
+	return statement_status(_stmt.execute_cached(results, ttl, tags));
 }
 
-bool odbc::fetch_direct(unordered_row &r)
+bool odbc::export_arrow(arrow_writer &w, size_t batch_rows)
 {
-    if(_executed && _connected)
-    {
-        SQLUSMALLINT col;
+	return statement_status(_stmt.export_arrow(w, batch_rows));
+}
 
-        try
-        {
-			SQLNumResultCols(_hstmt, (SQLSMALLINT*)&_fields);
-			set_field_descriptors();
+bool odbc::export_arrow(const TSTR &path, size_t batch_rows)
+{
+	return statement_status(_stmt.export_arrow(path, batch_rows));
+}
 
-			if(SQL_SUCCEEDED(SQLFetch(_hstmt)))
-			{
-				++_row_ptr;
-				unordered_row next_row(_row_ptr);
-
-				for(col=1;col<=_fields;++col)
-				{
-					SQLINTEGER indicator;
-					SQLTCHAR buf[255] = {0};
-
-					_rc = SQLGetData(_hstmt, col, SQL_C_TCHAR, buf, sizeof(buf), &indicator);
-
-					if(SQL_SUCCEEDED(_rc))
-					{
-						if(indicator == SQL_NULL_DATA)
-						{
-							field f(field_names[col-1],_T("NULL"));
-							next_row.add_field(f);
-						}
-						else
-						{
-							field f(field_names[col-1],(TCHAR*)buf);
-							next_row.add_field(f);
-						}
-					}
-					else
-					{
-						field f(field_names[col-1],_T("NULL"));
-						next_row.add_field(f);
-					}
-				}
-
-				r = next_row;
-				return true;
-			}
-			else
-			{
-			    _row_ptr = 0;
-			    return false;
-			}
-        }
-        catch(_com_error &e)
-		{
-			_err = _T("_com_error: ") + e.Error();
-		}
-    }
+#if defined(ODBC_COROUTINES)
+row_generator odbc::stream()
+{
+	return _stmt.stream();
+}
 
-    _row_ptr = 0;
-    return false;
+block_awaitable odbc::next_block(result_set &block)
+{
+	return _stmt.next_block(block);
+}
+
+block_awaitable odbc::next_block(result_set &block, block_awaitable::resumer resume)
+{
+	return _stmt.next_block(block, resume);
 }
+#endif
 
 // fetches each DSN & DSN Description from the DSN table
 // initialized on ODBC init, will return blank if ODBC failed to connect
@@ -498,74 +446,175 @@ bool odbc::fetch_dsn(TSTR &dsn, TSTR &dsn_desc)
     return true;
 }
 
-
 TSTR odbc::get_field_name(unsigned long col)
 {
-	TSTR ret;
-
-	if(col >= 1 && col <= _fields)
-	{
-		ret = (TCHAR*)field_info.at(col-1).colName;
-	}
+	return _stmt.get_field_name(col);
+}
 
-	return ret;
+bool odbc::move_to_result_set(unsigned long set_pos)
+{
+	return _stmt.move_to_result_set(set_pos);
 }
 
 unsigned long odbc::fields()
 {
-	return _fields;
+	return _stmt.fields();
 }
 
 unsigned long odbc::rows()
 {
-	return _rows;
+	return _stmt.rows();
 }
 
-bool odbc::move_to_result_set(unsigned long set_pos)
+unsigned long odbc::affected_rows()
 {
-    if(_executed && _connected)
-    {
-        //_rc = SQL_SUCCEEDED(SQLFetchScroll(_hstmt,SQL_FETCH_FIRST,set_pos));
-        while(set_pos)
-        {
-            _rc = (SQLMoreResults(_hstmt)!=SQL_NO_DATA);
-            set_pos--;
-        }
-        return _rc;
-    }
+	return _stmt.affected_rows();
+}
 
-    return false;
+unsigned long odbc::failed_rows()
+{
+	return _stmt.failed_rows();
 }
 
-unsigned long odbc::affected_rows()
+// instance settings are kept for statements created later
+void odbc::set_rowset_size(SQLULEN rows)
 {
-    SQLLEN i;
-    if(_executed && _connected)
-    {
-        _rc = SQL_SUCCEEDED(SQLRowCount(_hstmt,&i));
-        _affected_rows = i;
-    }
+	_rowset_size = rows ? rows : 1;
+	_stmt.set_rowset_size(rows);
+}
+
+void odbc::set_statement_rowset_size(SQLULEN rows)
+{
+	_stmt.set_statement_rowset_size(rows);
+}
+
+SQLULEN odbc::rowset_size()
+{
+	return _stmt.rowset_size();
+}
+
+void odbc::set_typed_fetch(bool typed)
+{
+	_typed = typed;
+	_stmt.set_typed_fetch(typed);
+}
+
+bool odbc::typed_fetch()
+{
+	return _typed;
+}
+
+void odbc::set_lob_streaming(bool stream)
+{
+	_stream_lobs = stream;
+	_stmt.set_lob_streaming(stream);
+}
+
+bool odbc::lob_streaming()
+{
+	return _stream_lobs;
+}
+
+void odbc::set_prefetch(size_t blocks)
+{
+	_prefetch = blocks;
+	_stmt.set_prefetch(blocks);
+}
+
+size_t odbc::prefetch()
+{
+	return _prefetch;
+}
+
+void odbc::set_memory_budget(size_t bytes)
+{
+	_memory_budget = bytes;
+	_stmt.set_memory_budget(bytes);
+}
+
+size_t odbc::memory_budget()
+{
+	return _memory_budget;
+}
+
+void odbc::set_result_cache(std::shared_ptr<result_cache> cache)
+{
+	_result_cache = cache;
+	_stmt.set_result_cache(cache);
+}
 
-	return _affected_rows;
+std::shared_ptr<result_cache> odbc::get_result_cache()
+{
+	return _result_cache;
+}
+
+lob_reader odbc::open_lob(SQLUSMALLINT col)
+{
+	return _stmt.open_lob(col);
+}
+
+lob_reader odbc::open_lob(SQLUSMALLINT col, SQLSMALLINT c_type)
+{
+	return _stmt.open_lob(col, c_type);
+}
+
+void odbc::set_statement_cache_size(size_t size)
+{
+	_stmt.set_statement_cache_size(size);
+}
+
+size_t odbc::statement_cache_size()
+{
+	return _stmt.statement_cache_size();
+}
+
+unsigned long odbc::statement_cache_hits()
+{
+	return _stmt.statement_cache_hits();
+}
+
+unsigned long odbc::statement_cache_misses()
+{
+	return _stmt.statement_cache_misses();
+}
+
+void odbc::set_metrics(bool enabled)
+{
+	_metrics.set_enabled(enabled);
+}
+
+bool odbc::metrics_enabled()
+{
+	return _metrics.enabled();
+}
+
+metrics_snapshot odbc::metrics()
+{
+	return _metrics.snapshot();
+}
+
+void odbc::reset_metrics()
+{
+	_metrics.reset();
+}
+
+bool odbc::dump_metrics(TSTR path)
+{
+	return _metrics.snapshot().dump(path);
 }
 
 /******************
 * PRIVATE METHODS *
 *******************/
 
+
 // initializes handlers
 void odbc::init()
 {
-	_fields = 0;
-	_rows = 0;
-	_row_ptr = 0;
-	_affected_rows = 0;
 	_connected = false;
 	_init = false;
-	_built = false;
-	_executed = false;
-	_bound = false;
-	_fetching = false;
+	_async_mode = SQL_AM_NONE;
+	_async_known = false;
 	_rc = SQL_SUCCESS;
 
 	try
@@ -583,24 +632,6 @@ void odbc::init()
 	}
 }
 
-// sets up the field_description vector
-void odbc::set_field_descriptors()
-{
-	field_description c;
-	c.colNumber = 1;
-	field_info.clear();
-
-	if(_hstmt)
-	{
-		while(Describe(c) == SQL_SUCCESS)
-		{
-			field_info.push_back(c);
-			field_names.push_back((TCHAR*)c.colName);
-			++c.colNumber;
-		}
-	}
-}
-
 void odbc::set_dsn_list()
 {
     TCHAR dsn[256];
@@ -626,135 +657,89 @@ void odbc::set_dsn_list()
     _dsn_itr = _dsntable.begin();
 }
 
-// returns a field_descriptor containing field data
-// queried from the DB
-SQLRETURN odbc::Describe(field_description& c)
-{
-	return SQLDescribeCol(_hstmt,c.colNumber,
-		(SQLTCHAR*)c.colName, sizeof(c.colName), &c.nameLen,
-		&c.dataType, &c.colSize, &c.decimalDigits, &c.nullable);
-}
-
-
-void odbc::build_result_set()
+// nothing is written out here, the records go to the log sink which
+// does its I/O elsewhere, so an error storm costs little more than the
+// SQLGetDiagRec calls themselves
+diag_record odbc::extract_error(const TCHAR *fn, SQLHANDLE handle, SQLSMALLINT type, diag_buffer &diag)
 {
-    if(_executed && !_built && _connected)
-    {
-        SQLUSMALLINT col;
-		unsigned long row_id = 0;
-        _fields = 0;
-        _rows = 0;
-
-        field_info.erase(field_info.begin(),field_info.end());
-        field_names.erase(field_names.begin(),field_names.end());
-		_table.erase(_table.begin(),_table.end());
-
-        try
-        {
-			SQLNumResultCols(_hstmt, (SQLSMALLINT*)&_fields);
-			set_field_descriptors();
-
-			while(SQL_SUCCEEDED(SQLFetch(_hstmt)))
-			{
-				++row_id;
-				unordered_row r(row_id);
-
-				for(col=1;col<=_fields;++col)
-				{
-					SQLINTEGER indicator;
-					SQLTCHAR buf[255] = {0};
-
-					_rc = SQLGetData(_hstmt, col, SQL_C_TCHAR, buf, sizeof(buf), &indicator);
-
-					if(SQL_SUCCEEDED(_rc))
-					{
-						if(indicator == SQL_NULL_DATA)
-						{
-							field f(field_names[col-1],_T("NULL"));
-							r.add_field(f);
-						}
-						else
-						{
-							field f(field_names[col-1],(TCHAR*)buf);
-							r.add_field(f);
-						}
-					}
-					else
-					{
-						field f(field_names[col-1],_T("NULL"));
-						r.add_field(f);
-					}
-				}
-				_table.insert(std::pair<unsigned long, unordered_row>(r.row_id(),r));
-			}
-
-			if(row_id>0)
-			{
-				_rows=row_id;
-			}
-        }
-        catch(_com_error &e)
-		{
-			_err = _T("_com_error: ") + e.Error();
-		}
-    }
-
-    _built = true;
-    _fetching = false;
-	_itr = _table.begin();
-}
-
-void odbc::extract_error(TCHAR *fn, SQLHANDLE handle, SQLSMALLINT type)
-{
-	SQLINTEGER i = 0;
-	SQLINTEGER native;
-	SQLTCHAR state[ 7 ];
-	SQLTCHAR text[256];
+	std::shared_ptr<log_sink> sink = log_sink::current();
+	diag_record rec, first;
+	SQLSMALLINT i = 0;
+	SQLTCHAR state[6];
+	SQLTCHAR text[SQL_MAX_MESSAGE_LENGTH];
 	SQLSMALLINT len;
 	SQLRETURN ret;
-	FTPRINTF(stderr,
-			 _T("The driver reported the following diagnostics whilst running ")
-			 _T("%s\n"),
-			 fn);
+
+	rec.function = fn;
+	rec.time = std::chrono::system_clock::now();
+	first = rec;
 
 	do
 	{
-        ret = SQLGetDiagRec(type, handle, ++i, state, &native, text, sizeof(text), &len );
+		ret = SQLGetDiagRec(type, handle, ++i, state, &rec.native, text, sizeof(text)/sizeof(text[0]), &len);
 
-		if (SQL_SUCCEEDED(ret))
-            _tprintf(_T("%s:%ld:%ld:%s\n"), state, i, native, text);
+		if(SQL_SUCCEEDED(ret))
+		{
+			rec.state = (TCHAR*)state;
+			rec.message = (TCHAR*)text;
+			rec.record = i;
+
+			diag.push(rec);
+			if(sink) sink->write(rec);
+			if(i == 1) first = rec;
+		}
 	}
-	while( ret == SQL_SUCCESS );
+	while(SQL_SUCCEEDED(ret));
+
+	return first;
 }
 
 void odbc::free_link()
 {
 	disconnect();
 
-	_fields = 0;
-    _rows = 0;
-    _row_ptr = 0;
-
-    field_info.erase(field_info.begin(),field_info.end());
-    field_names.erase(field_names.begin(),field_names.end());
-	_table.erase(_table.begin(),_table.end());
-
     if(_connected)
     {
-        if(_hstmt) _rc = SQLFreeStmt(_hstmt, SQL_DROP);
         if(_hdbc) _rc = SQLFreeHandle(SQL_HANDLE_DBC,_hdbc);
         if(_henv) _rc = SQLFreeHandle(SQL_HANDLE_ENV,_henv);
     }
 
 	_init = false;
+}
+
+// picks up the return code and error of the default statement
+bool odbc::statement_status(bool ok)
+{
+	_rc = _stmt.last_status();
+
+	if(!ok && !_stmt.last_error().empty())
+		_err = _stmt.last_error();
+
+	return ok;
+}
+
+// statements must go before the connection does, the
+// created ones are told so they don't free their handle twice
+// and are kept to be attached again by the next connect()
+void odbc::detach_statements()
+{
+	std::vector<statement*>::iterator itr;
 
-	_sql_stmt.clear();
-	_bound = false;
-	_built = false;
-	_executed = false;
+	for(itr=_statements.begin();itr!=_statements.end();++itr)
+	{
+		(*itr)->detach();
+		(*itr)->_err = _T("Failed to run, statement detached by disconnect until the next connect()");
+	}
+
+	_stmt.detach();
 }
 
-void odbc::reset_iterator()
+// a statement that fails to get a handle keeps the reason in
+// its last_error(), the connection itself is still good
+void odbc::attach_statements()
 {
-    if(!(&_itr==&_table.begin())) _itr = _table.begin();
+	std::vector<statement*>::iterator itr;
+
+	for(itr=_statements.begin();itr!=_statements.end();++itr)
+		(*itr)->attach(*this);
 }
@@ -16,6 +16,8 @@
 // -	.\Program Files\Microsoft Visual Studio x.x\VC\include
 // -	.\Program Files\Microsoft Visual Studio x.x\VC\lib
 // -	.\Program Files\Microsoft Visual Studio x.x\VC\bin
+//
+// The result set views use std::string_view, compile with C++17 or later
 
 
 
@@ -23,27 +25,58 @@
 #define ODBC_CON_H
 
 #define SQL_SUCCEEDED(rc) (((rc)&(~1))==0)
-#define RMAP std::map<unsigned long,unordered_row>
 #define DSNMAP std::map<TSTR,TSTR>
 
+#include <cstdio>
 #include <iostream>
+#include <iterator>
 #include <stdexcept>
 #include <vector>
 #include <string>
-#include <windows.h>
-#include <tchar.h>
+#if defined(_WIN32)
+    #include <windows.h>
+    #include <tchar.h>
+#endif
 #include <sql.h>
 #include <sqltypes.h>
 #include <sqlucode.h>
 #include <sqlext.h>
-#include <conio.h>
-#include <comdef.h>
-#include <mbstring.h>
+#if defined(_WIN32)
+    #include <conio.h>
+    #include <comdef.h>
+    #include <mbstring.h>
+#else
+    // unixODBC builds, narrow characters only as its SQLWCHAR is
+    // 2 bytes where wchar_t is 4, stand in for tchar.h and comdef.h
+    #if defined(UNICODE) || defined(_UNICODE_)
+        #error "UNICODE builds need the Windows ODBC headers"
+    #endif
+    #if !defined(_T)
+        #define _T(x)       x
+    #endif
+    #if !defined(_tprintf)
+        #define _tprintf    printf
+    #endif
+    // only raised by the COM runtime, which never runs here
+    class _com_error { public: long Error() const { return 0; } };
+#endif
 #include "table.h"
+#include "result_set.h"
+#include "diag.h"
+#include "metrics.h"
+#include "cursor.h"
+#include "stmt_cache.h"
+#include "result_cache.h"
+#include "bind.h"
+#include "row_map.h"
+#include "arrow.h"
+#include "statement.h"
 #include <map>
 #include <unordered_map>
-#pragma comment( lib, "odbc32.lib" )
-#pragma warning(disable: 4996)3
+#if defined(_MSC_VER)
+    #pragma comment( lib, "odbc32.lib" )
+    #pragma warning(disable: 4996)
+#endif
 
 
 /** UNICODE SUPPORT **/
@@ -113,16 +146,6 @@
 // SQL_NO_DATA = 99
 
 class odbc;
-struct param;
-
-struct param
-{
-	SQLSMALLINT col;
-	TSTR val;
-	SQLSMALLINT type;
-	SQLULEN size;
-	SQLSMALLINT decimals;
-};
 
 
 class odbc
@@ -151,11 +174,28 @@ class odbc
 
 		// returns the current connection status
 		bool connection_status();
+		// asks the driver whether the connection has dropped, this is
+		// SQL_ATTR_CONNECTION_DEAD so no round trip to the server is made
+		bool is_alive();
+		// returns the driver's SQL_ASYNC_MODE, SQL_AM_NONE
+		// when statements can't be run asynchronously
+		SQLUINTEGER async_mode();
 
 		// returns the last return code for the last SQL operation
 		SQLRETURN last_status();
-		// returns a custom error message if any
+		// returns a custom error message if any, driver failures read
+		// "function: [SQLSTATE] (native error) message"
 		TSTR last_error();
+		// returns the SQLSTATE of the newest diagnostic record
+		TSTR last_state();
+		// returns the most recent diagnostic records of the connection and
+		// the default statement, oldest first, up to ODBC_DIAG_RECORDS each
+		std::vector<diag_record> diagnostics();
+		void clear_diagnostics();
+
+		// sink every connection logs its diagnostic records to, by default
+		// stderr written from a background thread, NULL turns logging off
+		static void set_log_sink(std::shared_ptr<log_sink> sink);
 
 		// returns odbc formatted connection string on successful connection
         TSTR connection_string();
@@ -163,10 +203,30 @@ class odbc
 		// prepares a SQL statement and then binds a list of parameters
 		// requires the list to be param structs to build the binding
 		bool prepare_and_bind(TSTR sql_stmt,std::vector<param> params);
-		// prepares a SQL statement
+		// prepares a SQL statement, with the statement cache on the
+		// same SQL text reuses its prepared handle and skips SQLPrepare
 		bool prepare(TSTR sql_stmt);
 		// binds parameters to the prepared statement
 		bool bind_param(short col, TSTR val, short sql_field_type, SQLULEN col_size ,short decimal_pts);
+		// binds value in its native type, copied into a buffer the statement
+		// reuses for the column, see statement::bind()
+		template<class T>
+		bool bind(SQLUSMALLINT col, const T &value) { return statement_status(_stmt.bind(col, value)); }
+		bool bind(SQLUSMALLINT col, const TCHAR *value) { return statement_status(_stmt.bind(col, value)); }
+		// binds a fixed size value in place, it must outlive the execute
+		template<class T>
+		bool bind_ref(SQLUSMALLINT col, T &value) { return statement_status(_stmt.bind_ref(col, value)); }
+
+		// executes the prepared statement once per parameter set in a single
+		// driver call, every param_array must hold the same number of values
+		bool execute_batch(std::vector<param_array> &params);
+		// executes the prepared statement for sets rows of a caller owned
+		// struct array, row_size is the size of one struct
+		bool execute_batch(std::vector<param_binding> &bindings, SQLULEN row_size, SQLULEN sets);
+		// returns the SQL_PARAM_* status of every set in the last batch
+		std::vector<SQLUSMALLINT> batch_status();
+		// returns the number of parameter sets processed by the last batch
+		SQLULEN batch_processed();
 
 		// clears the last prepared statement without closing the connection
 		void free_session();
@@ -180,20 +240,68 @@ class odbc
 		// executes a non-bindable statement
 		bool execute_direct(TSTR sql_stmt);
 
+		// non-blocking execute(), execute_direct() and results() on the
+		// default statement, see statement.h, leave the connection
+		// alone until the future is ready
+		std::future<bool> execute_async();
+		std::future<bool> execute_direct_async(TSTR sql_stmt);
+		std::future<const result_set&> results_async();
+
 		// fetches a unordered_row at a time
 		bool fetch(unordered_row &r);
 
 		// fetches a unordered_row at a time by reference
-		// this allows unordered_row data to have settings changed
+		// this allows unordered_row data to have settings changed,
+		// the row is a copy that is replaced by the next fetch
 		bool fetch(unordered_row *&r);
 
+		// fetches a row_view at a time, the view points straight into
+		// the result set so no row data is copied
+		bool fetch(row_view &r);
+
 		// fetches a specific unordered_row from result set
 		unordered_row fetch_row(unsigned long row_id);
+		// points a row_view at a specific row of the result set
+		bool fetch_row(unsigned long row_id, row_view &r);
+
+		// returns the columnar result set, building it if necessary
+		// rows are read from it through row_views without copying
+		const result_set &results();
 
         // fetches each row directly from the database
         // slower but will handle very large data set sizes since
-        // it doesnt load the data into memory first and eliminates memory errors
+        // it doesnt load the data into memory first and eliminates memory errors,
+        // set_memory_budget() keeps results() random access for those instead
 		bool fetch_direct(unordered_row &r);
+		// streams each row as a view into the cursor's block buffer, the
+		// view is only valid until the next call, memory stays constant
+		bool fetch_direct(row_view &r);
+		// streams a whole rowset at a time into block, replacing the rows
+		// it held, reuse the same block so its storage is only grown once
+		bool fetch_block(result_set &block);
+		// fetches rows straight into structs mapped by row_mapping<T>,
+		// see statement::fetch_rows()
+		template<class T>
+		bool fetch_rows(std::vector<T> &rows, size_t max_rows = 0) { return statement_status(_stmt.fetch_rows(rows, max_rows)); }
+		// runs a query through a result cache attached with
+		// set_result_cache(), a hit skips the database entirely, see
+		// statement::execute_cached()
+		bool execute_cached(TSTR sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							const std::vector<TSTR> &tags = std::vector<TSTR>());
+		bool execute_cached(std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							const std::vector<TSTR> &tags = std::vector<TSTR>());
+		// writes the rest of the result set out as Arrow record batches,
+		// see statement::export_arrow()
+		bool export_arrow(arrow_writer &w, size_t batch_rows = ODBC_ARROW_BATCH_ROWS);
+		bool export_arrow(const TSTR &path, size_t batch_rows = ODBC_ARROW_BATCH_ROWS);
+
+#if defined(ODBC_COROUTINES)
+		// coroutine over fetch_direct(), yields one row_view per row
+		row_generator stream();
+		// awaitable over fetch_block(), suspends while the block is fetched
+		block_awaitable next_block(result_set &block);
+		block_awaitable next_block(result_set &block, block_awaitable::resumer resume);
+#endif
 
 		// fetches each DSN & DSN Description from the DSN table
 		// initialized on ODBC init, will return blank if ODBC failed to connect
@@ -213,32 +321,100 @@ class odbc
 
 		// returns the affected rows from statements like INSERT/DELETE/UPDATE
 		unsigned long affected_rows();
+		// returns the rows of the current result set the driver failed to
+		// fetch and left out, diagnostics() says why
+		unsigned long failed_rows();
+
+		// sets how many rows each SQLFetch returns for every statement run
+		// on this instance, anything above 1 binds the columns once and
+		// fetches whole blocks of rows instead of calling SQLGetData per cell
+		void set_rowset_size(SQLULEN rows);
+		// overrides the rowset size for the current statement only,
+		// the override is dropped again by free_statement()
+		void set_statement_rowset_size(SQLULEN rows);
+		// returns the rowset size the next fetch will use
+		SQLULEN rowset_size();
+
+		// when set, numeric, date/time and binary columns are fetched in
+		// their native C types instead of as text, read them back through
+		// row_view::get<T>() to skip string conversion entirely, decimals
+		// with a scale stay text so their value() matches the driver's
+		void set_typed_fetch(bool typed);
+		bool typed_fetch();
+
+		// when set, fetch_direct() leaves long text and binary columns on
+		// the statement instead of reading them whole, pull them through
+		// open_lob() a chunk at a time, e.g. file << lob_istream(db.open_lob(2)).rdbuf()
+		void set_lob_streaming(bool stream);
+		bool lob_streaming();
+
+		// overlaps the network with the caller's work when streaming, a
+		// background thread fetches up to blocks rowsets ahead of the one
+		// fetch_direct() or fetch_block() is reading, 1 double buffers and
+		// 2 triple buffers, 0 (the default) fetches on the calling thread,
+		// ignored with lob streaming on as open_lob() needs the statement
+		void set_prefetch(size_t blocks);
+		size_t prefetch();
+
+		// caps the heap results() builds the result set on, once the
+		// column buffers reach bytes they grow into a temporary memory
+		// mapped file, see ODBC_SPILL_DIR, which the OS pages to disk as
+		// needed, fetch_row() and iterating the rows work the same, only
+		// slower once pages have been evicted, 0 (the default) is no limit
+		// With a budget the buffers the columns outgrow are freed as they
+		// go, without one they are kept until the next statement, which
+		// can take up to twice the bytes of the rows themselves
+		void set_memory_budget(size_t bytes);
+		size_t memory_budget();
+
+		// opens a chunked reader over a long column of the row last returned
+		// by fetch_direct(), text is read as narrow characters unless c_type
+		// says otherwise, columns must be opened in ascending order
+		lob_reader open_lob(SQLUSMALLINT col);
+		lob_reader open_lob(SQLUSMALLINT col, SQLSMALLINT c_type);
+
+		// shares cache between this connection and the statements made on
+		// it afterwards, several connections can share one, NULL (the
+		// default) turns it off, writers drop stale entries through
+		// result_cache::invalidate() with the tags of the tables they change
+		void set_result_cache(std::shared_ptr<result_cache> cache);
+		std::shared_ptr<result_cache> get_result_cache();
+
+		// keeps up to size prepared statement handles on this connection,
+		// least recently used are freed first, 0 (the default) turns the
+		// cache off, shrinking it frees every cached handle
+		void set_statement_cache_size(size_t size);
+		size_t statement_cache_size();
+		// number of prepare() calls that reused a cached handle and that didn't
+		unsigned long statement_cache_hits();
+		unsigned long statement_cache_misses();
+
+		// records prepare, execute, fetch, decode and describe latencies
+		// and row, byte, driver call, reconnect and error counts for every
+		// statement on this connection, off by default, see metrics.h
+		void set_metrics(bool enabled);
+		bool metrics_enabled();
+		// returns a copy of everything recorded so far
+		metrics_snapshot metrics();
+		// zeroes every histogram and counter
+		void reset_metrics();
+		// writes a snapshot to path in the Prometheus text format,
+		// e.g. for node_exporter's textfile collector
+		bool dump_metrics(TSTR path);
 
 	private:
+		friend class statement;
+		friend class cursor;
+
 		// err/info value
         TSTR _err;
 
-		// stores field data for active table
-        struct field_description
-        {
-            SQLSMALLINT colNumber;
-            SQLTCHAR colName[80];
-            SQLSMALLINT nameLen;
-            SQLSMALLINT dataType;
-            SQLULEN colSize;
-            SQLSMALLINT decimalDigits;
-            SQLSMALLINT nullable;
-        };
-
 		// ODBC handlers
 		// Environment handler
 		// must be initialized before connection
         SQLHANDLE _henv;
 		// Connection handler necessary before statement handler
         SQLHANDLE _hdbc;
-		// Statement handler wipes when connection handler
-		// disconnects, needs to be re-established each time
-        SQLHANDLE _hstmt;
 
 		// connection string for driver access
         TSTR _dsn;
@@ -247,12 +423,18 @@ class odbc
 		// user password for DB
         TSTR _pwd;
 
-		TSTR _sql_stmt;
-
-		unsigned long _fields;
-        unsigned long _rows;
-		unsigned long _affected_rows;
-		unsigned long _row_ptr;
+		// fetch settings for the instance, new statements start with these
+		SQLULEN _rowset_size;
+		// fetches columns in their native C types
+		bool _typed;
+		// leaves long columns to open_lob() when streaming
+		bool _stream_lobs;
+		// rowsets read ahead when streaming
+		size_t _prefetch;
+		// heap bytes of a built result set before it spills to disk
+		size_t _memory_budget;
+		// cache of built result sets handed to new statements
+		std::shared_ptr<result_cache> _result_cache;
 
 		// return code from ODBC based on last operation
         SQLRETURN _rc;
@@ -260,18 +442,21 @@ class odbc
 		// current connection status
         bool _connected;
 		bool _init;
-		bool _bound;
-		bool _built;
-		bool _executed;
-		bool _fetching;
-
-		// stores specific field info
-        std::vector<field_description> field_info;
-		// stores vector of field names
-        std::vector<TSTR> field_names;
-        RMAP _table;
-        RMAP::iterator _itr;
-        RMAP::iterator __itr;
+		// diagnostic records of the connection handle
+		diag_buffer _diag;
+		// timings and counts recorded by every statement on the connection
+		odbc_metrics _metrics;
+
+		// SQL_ASYNC_MODE reported by the driver, looked up once
+		SQLUINTEGER _async_mode;
+		bool _async_known;
+
+		// statement every query method above runs on, its handle is
+		// allocated on connect and it carries the statement cache
+        statement _stmt;
+		// statements created on this connection, their handles are freed
+		// on disconnect and allocated again on the next connect
+        std::vector<statement*> _statements;
 
         // holds DSN list
         DSNMAP _dsntable;
@@ -284,16 +469,17 @@ class odbc
         void init();
         // sets up the DSN listing from connected ODBC
         void set_dsn_list();
-		// sets up the field_description vector
-        void set_field_descriptors();
-		// returns a field_descriptor containing field data
-		// queried from the DB
-        SQLRETURN Describe(field_description& c);
 		void error_out();
-		void build_result_set();
-		void extract_error(TCHAR *fn,SQLHANDLE handle,SQLSMALLINT type);
+		// copies the default statement's status after a call
+		bool statement_status(bool ok);
+		// frees the handles of every statement on the connection
+		void detach_statements();
+		// allocates a handle for every statement created on the connection
+		void attach_statements();
+		// reads every diagnostic record of handle into diag and on to the
+		// log sink, returns the first one to build last_error() from
+		static diag_record extract_error(const TCHAR *fn, SQLHANDLE handle, SQLSMALLINT type, diag_buffer &diag);
 		void free_link();
-		void reset_iterator();
 };
 
 
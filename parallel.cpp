@@ -0,0 +1,430 @@
+#include "headers\parallel.h"
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+parallel_scan::parallel_scan(odbc_pool &pool, TSTR dsn)
+	: _dsn(dsn)
+{
+	_pool = &pool;
+	_rowset_size = 256;
+	_typed = false;
+	_depth = ODBC_SCAN_QUEUE_DEPTH;
+	_next = 0;
+	_running = 0;
+	_capacity = 0;
+	_stop = false;
+	_failed = false;
+	_pos = 0;
+	_rows = 0;
+}
+
+parallel_scan::parallel_scan(odbc_pool &pool, TSTR dsn, TSTR uid, TSTR pwd)
+	: _dsn(dsn), _uid(uid), _pwd(pwd)
+{
+	_pool = &pool;
+	_rowset_size = 256;
+	_typed = false;
+	_depth = ODBC_SCAN_QUEUE_DEPTH;
+	_next = 0;
+	_running = 0;
+	_capacity = 0;
+	_stop = false;
+	_failed = false;
+	_pos = 0;
+	_rows = 0;
+}
+
+parallel_scan::~parallel_scan()
+{
+	close();
+}
+
+// the bounds come from the same derived table the partitions
+// filter on, an empty key range leaves only the NULL partition
+bool parallel_scan::open(TSTR sql, TSTR column, unsigned int degree)
+{
+	SQLBIGINT low = 0, high = 0;
+	bool empty = true;
+	row_view r;
+
+	close();
+
+	_sql = sql;
+	_column = column;
+
+	pooled_connection conn = _pool->checkout(_dsn, _uid, _pwd);
+
+	if(!conn)
+	{
+		fail(_pool->last_error());
+		return false;
+	}
+
+	{
+		statement bounds(*conn);
+
+		if(!bounds.execute_direct(_T("SELECT MIN(") + column + _T("), MAX(") + column +
+								  _T(") FROM (") + sql + _T(") p")))
+		{
+			fail(_T("open(): ") + bounds.last_error());
+			conn.discard();
+			return false;
+		}
+
+		if(bounds.fetch_direct(r) && !r.is_null(1) && !r.is_null(2))
+		{
+			low = r.get_int(1);
+			high = r.get_int(2);
+			empty = false;
+		}
+	}
+
+	return start(std::move(conn), low, high, empty, degree);
+}
+
+bool parallel_scan::open(TSTR sql, TSTR column, unsigned int degree, SQLBIGINT low, SQLBIGINT high)
+{
+	close();
+
+	_sql = sql;
+	_column = column;
+
+	pooled_connection conn = _pool->checkout(_dsn, _uid, _pwd);
+
+	if(!conn)
+	{
+		fail(_pool->last_error());
+		return false;
+	}
+
+	return start(std::move(conn), low, high, high < low, degree);
+}
+
+void parallel_scan::close()
+{
+	std::vector<std::thread>::iterator itr;
+
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		_stop = true;
+	}
+
+	_ready_wake.notify_all();
+	_free_wake.notify_all();
+
+	for(itr=_workers.begin();itr!=_workers.end();++itr)
+		itr->join();
+
+	_workers.clear();
+	_partitions.clear();
+
+	while(!_ready.empty())
+	{
+		_free.push_back(std::move(_ready.front()));
+		_ready.pop_front();
+	}
+
+	if(_block) _free.push_back(std::move(_block));
+
+	_next = 0;
+	_running = 0;
+	_stop = false;
+	_failed = false;
+	_err.clear();
+	_pos = 0;
+	_rows = 0;
+	_table.clear();
+}
+
+bool parallel_scan::fetch(row_view &r)
+{
+	while(!_block || _pos >= _block->rows())
+	{
+		if(!next_block()) return false;
+	}
+
+	r = _block->row(++_pos);
+	++_rows;
+
+	return true;
+}
+
+bool parallel_scan::fetch(unordered_row &r)
+{
+	row_view v;
+
+	if(!fetch(v)) return false;
+
+	r = v.to_row(_rows);
+	return true;
+}
+
+// the rest of the current block goes first, then every block
+// the partitions hand over until they are all done
+const result_set &parallel_scan::results()
+{
+	bool first = true;
+
+	_table.clear();
+
+	if(_block && _pos < _block->rows())
+	{
+		_table.reset(_block->schema_ptr());
+		_table.append_rows(*_block, _pos);
+		_rows += _block->rows() - _pos;
+		_pos = _block->rows();
+		first = false;
+	}
+
+	while(next_block())
+	{
+		if(first)
+		{
+			_table.reset(_block->schema_ptr());
+			first = false;
+		}
+
+		_table.append_rows(*_block, 0);
+		_rows += _block->rows();
+		_pos = _block->rows();
+	}
+
+	return _table;
+}
+
+void parallel_scan::set_rowset_size(SQLULEN rows)
+{
+	_rowset_size = rows ? rows : 1;
+}
+
+void parallel_scan::set_typed_fetch(bool typed)
+{
+	_typed = typed;
+}
+
+void parallel_scan::set_queue_depth(size_t blocks)
+{
+	_depth = blocks ? blocks : 1;
+}
+
+size_t parallel_scan::partitions()
+{
+	return _partitions.size();
+}
+
+unsigned long parallel_scan::rows()
+{
+	return _rows;
+}
+
+bool parallel_scan::failed()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _failed;
+}
+
+TSTR parallel_scan::last_error()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _err;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// the span is worked out unsigned so the full SQLBIGINT range can't
+// overflow, ranges that would hold no keys are left out
+bool parallel_scan::start(pooled_connection conn, SQLBIGINT low, SQLBIGINT high, bool empty, unsigned int degree)
+{
+	unsigned long long span, step, i;
+	size_t threads;
+	partition p;
+
+	if(!degree) degree = 1;
+
+	if(!empty)
+	{
+		span = (unsigned long long)high - (unsigned long long)low;
+		step = span / degree + 1;
+
+		for(i=0;i<degree && (i == 0 || i*step <= span);++i)
+		{
+			p.low = (SQLBIGINT)((unsigned long long)low + i*step);
+			p.high = (i == degree-1 || span - i*step < step) ? high
+				   : (SQLBIGINT)((unsigned long long)p.low + step - 1);
+			p.null = false;
+			_partitions.push_back(p);
+		}
+	}
+
+	p.low = 0;
+	p.high = 0;
+	p.null = true;
+	_partitions.push_back(p);
+
+	threads = std::min(_partitions.size(), (size_t)degree);
+
+	_next = 0;
+	_running = threads;
+	_capacity = _depth * threads;
+
+	_workers.push_back(std::thread(&parallel_scan::work, this, std::move(conn)));
+
+	for(i=1;i<threads;++i)
+		_workers.push_back(std::thread(&parallel_scan::work, this, pooled_connection()));
+
+	return true;
+}
+
+// the first worker runs on the connection open() already holds so the
+// scan always makes progress, the others check out their own and quit
+// if the pool has none to spare
+void parallel_scan::work(pooled_connection conn)
+{
+	std::unique_ptr<result_set> block;
+	partition p;
+	SQLRETURN rc;
+
+	if(!conn) conn = _pool->checkout(_dsn, _uid, _pwd);
+
+	if(conn)
+	{
+		statement st(*conn);
+		st.set_rowset_size(_rowset_size);
+		st.set_typed_fetch(_typed);
+
+		for(;;)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_lock);
+
+				if(_stop || _next >= _partitions.size()) break;
+
+				p = _partitions[_next++];
+			}
+
+			if(!st.execute_direct(partition_sql(p)))
+			{
+				fail(_T("execute_direct(): ") + st.last_error());
+				conn.discard();
+				break;
+			}
+
+			for(;;)
+			{
+				{
+					std::unique_lock<std::mutex> lock(_lock);
+					_free_wake.wait(lock, [this]{ return _stop || _ready.size() < _capacity; });
+
+					if(_stop) break;
+
+					if(!_free.empty())
+					{
+						block = std::move(_free.back());
+						_free.pop_back();
+					}
+					else
+						block.reset(new result_set());
+				}
+
+				if(!st.fetch_block(*block))
+				{
+					rc = st.last_status();
+
+					std::lock_guard<std::mutex> lock(_lock);
+					_free.push_back(std::move(block));
+
+					if(!SQL_SUCCEEDED(rc) && rc != SQL_NO_DATA)
+					{
+						if(!_failed)
+						{
+							_failed = true;
+							_err = _T("fetch_block(): ") + st.last_error();
+						}
+						_stop = true;
+						_ready_wake.notify_all();
+						_free_wake.notify_all();
+					}
+
+					break;
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(_lock);
+					_ready.push_back(std::move(block));
+				}
+
+				_ready_wake.notify_one();
+			}
+
+			st.free_statement();
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		--_running;
+	}
+
+	_ready_wake.notify_all();
+}
+
+TSTR parallel_scan::partition_sql(const partition &p)
+{
+	std::basic_ostringstream<TCHAR> sql;
+
+	sql << _T("SELECT * FROM (") << _sql << _T(") p WHERE ") << _column;
+
+	if(p.null)
+		sql << _T(" IS NULL");
+	else
+		sql << _T(" BETWEEN ") << p.low << _T(" AND ") << p.high;
+
+	return sql.str();
+}
+
+// a failed scan hands out nothing more, even blocks already fetched
+bool parallel_scan::next_block()
+{
+	std::unique_lock<std::mutex> lock(_lock);
+
+	if(_block)
+	{
+		_free.push_back(std::move(_block));
+		_free_wake.notify_one();
+	}
+
+	_pos = 0;
+
+	_ready_wake.wait(lock, [this]{ return _failed || !_ready.empty() || !_running; });
+
+	if(_failed || _ready.empty()) return false;
+
+	_block = std::move(_ready.front());
+	_ready.pop_front();
+
+	return true;
+}
+
+void parallel_scan::fail(const TSTR &err)
+{
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+
+		if(!_failed)
+		{
+			_failed = true;
+			_err = err;
+		}
+
+		_stop = true;
+	}
+
+	_ready_wake.notify_all();
+	_free_wake.notify_all();
+}
@@ -0,0 +1,137 @@
+/*
+  Name: parallel.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Range partitioned parallel scan over pooled connections
+               The key range of an integer column is split into one
+               BETWEEN range per connection, the ranges run at the same
+               time and their rows come back as a single stream
+*/
+
+#ifndef ODBC_PARALLEL_H
+#define ODBC_PARALLEL_H
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "pool.h"
+
+// default number of blocks each partition may fetch ahead of the reader
+#if !defined(ODBC_SCAN_QUEUE_DEPTH)
+    #define ODBC_SCAN_QUEUE_DEPTH 4
+#endif
+
+// Runs a query as degree partitions of the form
+//     SELECT * FROM (sql) p WHERE column BETWEEN low AND high
+// plus one for NULL keys, each on its own pooled connection, rows come
+// back in no particular order, the scan is used from a single thread
+class parallel_scan
+{
+	public:
+		// connections are checked out of pool for the DSN/credential set,
+		// the pool needs max_size >= degree for every partition to run at once
+		parallel_scan(odbc_pool &pool, TSTR dsn);
+		parallel_scan(odbc_pool &pool, TSTR dsn, TSTR uid, TSTR pwd);
+		// stops the partitions still running
+		~parallel_scan();
+
+		parallel_scan(const parallel_scan&) = delete;
+		parallel_scan &operator=(const parallel_scan&) = delete;
+
+		// reads MIN/MAX of column over sql, splits that range into degree
+		// partitions and starts them, column must be an integer column
+		bool open(TSTR sql, TSTR column, unsigned int degree);
+		// same as above for a key range already known, skips MIN/MAX
+		bool open(TSTR sql, TSTR column, unsigned int degree, SQLBIGINT low, SQLBIGINT high);
+
+		// stops any partitions still running and drops their rows
+		void close();
+
+		// streams the merged rows, the view is only valid until the
+		// next call, returns false once every partition is done or one
+		// of them failed, see last_error()
+		bool fetch(row_view &r);
+		bool fetch(unordered_row &r);
+
+		// collects the rows not fetched yet into one result set
+		const result_set &results();
+
+		// rows per SQLFetch on every partition, defaults to 256
+		void set_rowset_size(SQLULEN rows);
+		// fetches columns in their native C types
+		void set_typed_fetch(bool typed);
+		// blocks each partition may hold before waiting on the reader
+		void set_queue_depth(size_t blocks);
+
+		// returns the number of partitions the last open() started
+		size_t partitions();
+		// returns the number of rows handed out so far
+		unsigned long rows();
+		// returns whether the scan stopped on an error
+		bool failed();
+		TSTR last_error();
+
+	private:
+		// key range of a partition, null selects the NULL keys
+		struct partition
+		{
+			SQLBIGINT low;
+			SQLBIGINT high;
+			bool null;
+		};
+
+		odbc_pool *_pool;
+		TSTR _dsn;
+		TSTR _uid;
+		TSTR _pwd;
+
+		SQLULEN _rowset_size;
+		bool _typed;
+		size_t _depth;
+
+		TSTR _sql;
+		TSTR _column;
+		std::vector<partition> _partitions;
+		std::vector<std::thread> _workers;
+
+		// shared with the workers, next partition to run, full
+		// blocks waiting for the reader and spent blocks to reuse
+		std::mutex _lock;
+		std::condition_variable _ready_wake;
+		std::condition_variable _free_wake;
+		size_t _next;
+		size_t _running;
+		// most full blocks allowed to wait for the reader
+		size_t _capacity;
+		std::deque<std::unique_ptr<result_set> > _ready;
+		std::vector<std::unique_ptr<result_set> > _free;
+		bool _stop;
+		bool _failed;
+		TSTR _err;
+
+		// block being read and the position in it
+		std::unique_ptr<result_set> _block;
+		size_t _pos;
+		unsigned long _rows;
+
+		result_set _table;
+
+		// splits [low, high] and starts the workers on conn plus
+		// as many more connections as the pool hands out
+		bool start(pooled_connection conn, SQLBIGINT low, SQLBIGINT high, bool empty, unsigned int degree);
+		// runs partitions until there are none left
+		void work(pooled_connection conn);
+		// returns the SQL for a partition
+		TSTR partition_sql(const partition &p);
+		// moves the next full block into _block, waits for one if needed
+		bool next_block();
+		// records the first error and stops every worker
+		void fail(const TSTR &err);
+};
+
+
+#endif
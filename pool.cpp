@@ -0,0 +1,349 @@
+#include "headers\pool.h"
+
+/********************
+* POOLED CONNECTION *
+*********************/
+
+pooled_connection::pooled_connection()
+{
+	_pool = NULL;
+	_discard = false;
+}
+
+pooled_connection::pooled_connection(odbc_pool *pool, const TSTR &key, std::unique_ptr<odbc> conn)
+	: _key(key), _conn(std::move(conn))
+{
+	_pool = pool;
+	_discard = false;
+}
+
+pooled_connection::pooled_connection(pooled_connection &&other)
+	: _key(std::move(other._key)), _conn(std::move(other._conn))
+{
+	_pool = other._pool;
+	_discard = other._discard;
+	other._pool = NULL;
+}
+
+pooled_connection &pooled_connection::operator=(pooled_connection &&other)
+{
+	if(this != &other)
+	{
+		release();
+
+		_pool = other._pool;
+		_key = std::move(other._key);
+		_conn = std::move(other._conn);
+		_discard = other._discard;
+		other._pool = NULL;
+	}
+
+	return *this;
+}
+
+pooled_connection::~pooled_connection()
+{
+	release();
+}
+
+odbc *pooled_connection::operator->()
+{
+	return _conn.get();
+}
+
+odbc &pooled_connection::operator*()
+{
+	return *_conn;
+}
+
+odbc *pooled_connection::get()
+{
+	return _conn.get();
+}
+
+pooled_connection::operator bool() const
+{
+	return _conn != nullptr;
+}
+
+void pooled_connection::release()
+{
+	if(_pool && _conn)
+		_pool->checkin(_key, std::move(_conn), _discard);
+
+	_conn.reset();
+	_pool = NULL;
+	_discard = false;
+}
+
+void pooled_connection::discard()
+{
+	_discard = true;
+	release();
+}
+
+/************
+* ODBC POOL *
+*************/
+
+odbc_pool::odbc_pool(size_t min_size, size_t max_size)
+{
+	_max_size = max_size ? max_size : 1;
+	_min_size = min_size > _max_size ? _max_size : min_size;
+	_idle_timeout = std::chrono::milliseconds(300000);
+	_checkout_timeout = std::chrono::milliseconds(30000);
+}
+
+odbc_pool::~odbc_pool()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	_buckets.clear();
+}
+
+void odbc_pool::set_idle_timeout(std::chrono::milliseconds timeout)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	_idle_timeout = timeout;
+}
+
+void odbc_pool::set_checkout_timeout(std::chrono::milliseconds timeout)
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	_checkout_timeout = timeout;
+}
+
+pooled_connection odbc_pool::checkout(TSTR dsn)
+{
+	return checkout(dsn, TSTR(), TSTR());
+}
+
+// reuses the most recently returned connection first since it is the
+// least likely to have been dropped by the server, dead connections are
+// thrown away and replaced, at max_size this waits for a checkin
+pooled_connection odbc_pool::checkout(TSTR dsn, TSTR uid, TSTR pwd)
+{
+	std::vector<std::unique_ptr<odbc> > dropped;
+	std::unique_ptr<odbc> conn;
+	TSTR key, err;
+	std::unique_lock<std::mutex> lock(_lock);
+	bucket &b = find_bucket(dsn, uid, pwd, key);
+	clock::time_point deadline = clock::now() + _checkout_timeout;
+
+	for(;;)
+	{
+		evict(b, clock::now(), dropped);
+
+		while(!b.idle.empty())
+		{
+			conn = std::move(b.idle.back().conn);
+			b.idle.pop_back();
+
+			if(conn->is_alive())
+				return pooled_connection(this, key, std::move(conn));
+
+			dropped.push_back(std::move(conn));
+			--b.open;
+		}
+
+		if(b.open < _max_size)
+		{
+			++b.open;
+
+			lock.unlock();
+			conn = open_connection(b, err);
+			lock.lock();
+
+			if(conn)
+				return pooled_connection(this, key, std::move(conn));
+
+			--b.open;
+			_err = err;
+			_returned.notify_one();
+
+			return pooled_connection();
+		}
+
+		if(_returned.wait_until(lock, deadline) == std::cv_status::timeout)
+		{
+			_err = _T("checkout(): timed out waiting for a free connection");
+			return pooled_connection();
+		}
+	}
+}
+
+bool odbc_pool::warm(TSTR dsn)
+{
+	return warm(dsn, TSTR(), TSTR());
+}
+
+bool odbc_pool::warm(TSTR dsn, TSTR uid, TSTR pwd)
+{
+	std::unique_ptr<odbc> conn;
+	TSTR key, err;
+	std::unique_lock<std::mutex> lock(_lock);
+	bucket &b = find_bucket(dsn, uid, pwd, key);
+
+	while(b.idle.size() < _min_size && b.open < _max_size)
+	{
+		++b.open;
+
+		lock.unlock();
+		conn = open_connection(b, err);
+		lock.lock();
+
+		if(!conn)
+		{
+			--b.open;
+			_err = err;
+			_returned.notify_one();
+			return false;
+		}
+
+		idle_connection c;
+		c.conn = std::move(conn);
+		c.since = clock::now();
+		b.idle.push_back(std::move(c));
+
+		_returned.notify_one();
+	}
+
+	return true;
+}
+
+size_t odbc_pool::evict_idle()
+{
+	std::vector<std::unique_ptr<odbc> > dropped;
+	std::map<TSTR, bucket>::iterator itr;
+	clock::time_point now = clock::now();
+	size_t n = 0;
+	std::lock_guard<std::mutex> lock(_lock);
+
+	for(itr=_buckets.begin();itr!=_buckets.end();++itr)
+		n += evict(itr->second, now, dropped);
+
+	return n;
+}
+
+size_t odbc_pool::idle()
+{
+	std::map<TSTR, bucket>::iterator itr;
+	size_t n = 0;
+	std::lock_guard<std::mutex> lock(_lock);
+
+	for(itr=_buckets.begin();itr!=_buckets.end();++itr)
+		n += itr->second.idle.size();
+
+	return n;
+}
+
+size_t odbc_pool::in_use()
+{
+	std::map<TSTR, bucket>::iterator itr;
+	size_t n = 0;
+	std::lock_guard<std::mutex> lock(_lock);
+
+	for(itr=_buckets.begin();itr!=_buckets.end();++itr)
+		n += itr->second.open - itr->second.idle.size();
+
+	return n;
+}
+
+TSTR odbc_pool::last_error()
+{
+	std::lock_guard<std::mutex> lock(_lock);
+
+	return _err;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+odbc_pool::bucket &odbc_pool::find_bucket(const TSTR &dsn, const TSTR &uid, const TSTR &pwd, TSTR &key)
+{
+	key = dsn + _T('\n') + uid + _T('\n') + pwd;
+
+	std::map<TSTR, bucket>::iterator itr = _buckets.find(key);
+
+	if(itr == _buckets.end())
+	{
+		bucket b;
+		b.dsn = dsn;
+		b.uid = uid;
+		b.pwd = pwd;
+		b.open = 0;
+
+		itr = _buckets.insert(std::make_pair(key, std::move(b))).first;
+	}
+
+	return itr->second;
+}
+
+// the bucket's credentials never change once it exists, so they can
+// be read here while other threads hold the lock
+std::unique_ptr<odbc> odbc_pool::open_connection(const bucket &b, TSTR &err)
+{
+	std::unique_ptr<odbc> conn(b.uid.empty() ? new odbc(b.dsn) : new odbc(b.dsn, b.uid, b.pwd));
+
+	if(!conn->connect())
+	{
+		err = conn->last_error();
+		if(err.empty()) err = _T("checkout(): could not connect to ") + b.dsn;
+		return nullptr;
+	}
+
+	return conn;
+}
+
+// statements are freed before the connection is shared again so no
+// cursor or bindings leak to the next borrower, dropped connections
+// disconnect after the lock is released when conn goes out of scope
+void odbc_pool::checkin(const TSTR &key, std::unique_ptr<odbc> conn, bool discard)
+{
+	if(!discard && conn->connection_status())
+		conn->free_statement();
+
+	if(!discard && !conn->is_alive())
+		discard = true;
+
+	{
+		std::lock_guard<std::mutex> lock(_lock);
+		std::map<TSTR, bucket>::iterator itr = _buckets.find(key);
+
+		if(itr != _buckets.end())
+		{
+			if(discard)
+				--itr->second.open;
+			else
+			{
+				idle_connection c;
+				c.conn = std::move(conn);
+				c.since = clock::now();
+				itr->second.idle.push_back(std::move(c));
+			}
+		}
+	}
+
+	_returned.notify_one();
+}
+
+// the oldest connections sit at the front of the queue
+size_t odbc_pool::evict(bucket &b, clock::time_point now, std::vector<std::unique_ptr<odbc> > &dropped)
+{
+	size_t n = 0;
+
+	if(_idle_timeout.count() <= 0) return 0;
+
+	while(b.idle.size() > _min_size && now - b.idle.front().since >= _idle_timeout)
+	{
+		dropped.push_back(std::move(b.idle.front().conn));
+		b.idle.pop_front();
+		--b.open;
+		++n;
+	}
+
+	return n;
+}
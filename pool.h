@@ -0,0 +1,145 @@
+/*
+  Name: pool.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Thread-safe pool of warm odbc connections
+               Connections are kept per DSN and credential set and are
+               handed out through pooled_connection, which puts them back
+               into the pool when it goes out of scope
+*/
+
+#ifndef ODBC_POOL_H
+#define ODBC_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "odbc.h"
+
+class odbc_pool;
+
+// RAII handle on a checked out connection, move only, the connection
+// goes back to its pool on destruct or release()
+class pooled_connection
+{
+	public:
+		// default constructor, holds no connection
+		pooled_connection();
+		pooled_connection(pooled_connection &&other);
+		pooled_connection &operator=(pooled_connection &&other);
+		pooled_connection(const pooled_connection&) = delete;
+		pooled_connection &operator=(const pooled_connection&) = delete;
+		// returns the connection to the pool
+		~pooled_connection();
+
+		odbc *operator->();
+		odbc &operator*();
+		odbc *get();
+		// returns whether a connection is held
+		explicit operator bool() const;
+
+		// returns the connection to the pool early
+		void release();
+		// disconnects instead of returning to the pool, use after
+		// errors that leave the connection in an unknown state
+		void discard();
+
+	private:
+		friend class odbc_pool;
+
+		pooled_connection(odbc_pool *pool, const TSTR &key, std::unique_ptr<odbc> conn);
+
+		odbc_pool *_pool;
+		TSTR _key;
+		std::unique_ptr<odbc> _conn;
+		bool _discard;
+};
+
+// Keeps between min_size and max_size connections per DSN/credential set,
+// the pool must outlive every pooled_connection checked out of it
+class odbc_pool
+{
+	public:
+		// eviction never takes a key below min_size idle connections and
+		// warm() fills it up front, no more than max_size are open per key
+		odbc_pool(size_t min_size, size_t max_size);
+		// disconnects the idle connections
+		~odbc_pool();
+
+		// idle connections above min_size are disconnected once they
+		// have not been used for this long, 0 keeps them forever
+		void set_idle_timeout(std::chrono::milliseconds timeout);
+		// how long checkout() waits for a connection when max_size are in use
+		void set_checkout_timeout(std::chrono::milliseconds timeout);
+
+		// hands out an idle connection that is still alive or opens a new
+		// one, returns an empty handle on failure, see last_error()
+		pooled_connection checkout(TSTR dsn);
+		pooled_connection checkout(TSTR dsn, TSTR uid, TSTR pwd);
+
+		// opens connections until min_size are idle for the key
+		bool warm(TSTR dsn);
+		bool warm(TSTR dsn, TSTR uid, TSTR pwd);
+
+		// disconnects idle connections past the idle timeout,
+		// returns how many were dropped
+		size_t evict_idle();
+
+		// returns the number of idle and checked out connections
+		size_t idle();
+		size_t in_use();
+
+		// returns the error from the last failed checkout or warm
+		TSTR last_error();
+
+	private:
+		friend class pooled_connection;
+
+		typedef std::chrono::steady_clock clock;
+
+		// idle connection and when it was returned
+		struct idle_connection
+		{
+			std::unique_ptr<odbc> conn;
+			clock::time_point since;
+		};
+
+		// connections of a single DSN/credential set, open counts
+		// idle and checked out connections plus any being connected
+		struct bucket
+		{
+			TSTR dsn;
+			TSTR uid;
+			TSTR pwd;
+			std::deque<idle_connection> idle;
+			size_t open;
+		};
+
+		size_t _min_size;
+		size_t _max_size;
+		std::chrono::milliseconds _idle_timeout;
+		std::chrono::milliseconds _checkout_timeout;
+
+		std::mutex _lock;
+		std::condition_variable _returned;
+		std::map<TSTR, bucket> _buckets;
+		TSTR _err;
+
+		// returns the bucket for a credential set, creating it if needed
+		bucket &find_bucket(const TSTR &dsn, const TSTR &uid, const TSTR &pwd, TSTR &key);
+		// opens a new connection, called without the lock held
+		std::unique_ptr<odbc> open_connection(const bucket &b, TSTR &err);
+		// takes a connection back from a pooled_connection
+		void checkin(const TSTR &key, std::unique_ptr<odbc> conn, bool discard);
+		// moves idle connections past the timeout into dropped so they
+		// are disconnected once the lock is released, call with it held
+		size_t evict(bucket &b, clock::time_point now, std::vector<std::unique_ptr<odbc> > &dropped);
+};
+
+
+#endif
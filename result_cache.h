@@ -0,0 +1,281 @@
+/*
+  Name: result_cache.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Client side cache of built result sets keyed by normalized
+               SQL text and parameter values, entries expire after their
+               TTL, the least recently used are evicted past a byte budget
+               and every entry under a table tag can be dropped at once
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "result_set.h"
+
+// default bytes of result sets a cache holds before evicting
+#if !defined(ODBC_RESULT_CACHE_BYTES)
+    #define ODBC_RESULT_CACHE_BYTES (64*1024*1024)
+#endif
+
+// Thread safe, one cache can be shared by every connection of a process
+// through statement::set_result_cache(), cached result sets are handed
+// out as shared_ptrs to const so readers share them without copying and
+// an entry evicted while in use lives on until its last reader lets go
+// Nothing is invalidated on its own, writers call invalidate() with the
+// tags of the tables they change
+class result_cache
+{
+    public:
+        typedef std::chrono::steady_clock clock;
+
+        result_cache(size_t max_bytes = ODBC_RESULT_CACHE_BYTES)
+            : _max_bytes(max_bytes), _bytes(0), _epoch(0), _hits(0), _misses(0), _evictions(0) {}
+
+        result_cache(const result_cache&) = delete;
+        result_cache &operator=(const result_cache&) = delete;
+
+        // bytes of result sets kept, lowering it evicts straight away
+        void set_max_bytes(size_t bytes)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+
+            _max_bytes = bytes;
+            trim(0);
+        }
+        size_t max_bytes() { std::lock_guard<std::mutex> lock(_lock); return _max_bytes; }
+        // bytes of result sets and number of entries currently cached
+        size_t bytes() { std::lock_guard<std::mutex> lock(_lock); return _bytes; }
+        size_t size() { std::lock_guard<std::mutex> lock(_lock); return _entries.size(); }
+
+        // returns the result set cached under key and marks it most
+        // recently used, empty on a miss, expired entries are dropped,
+        // epoch is set to pass back to insert() after a miss so a result
+        // built while an invalidate() ran isn't cached
+        std::shared_ptr<const result_set> find(const std::string &key, unsigned long long &epoch)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            std::unordered_map<std::string, entry_list::iterator>::iterator itr = _index.find(key);
+
+            epoch = _epoch;
+
+            if(itr != _index.end() && itr->second->expires < clock::now())
+            {
+                erase(itr->second);
+                itr = _index.end();
+            }
+
+            if(itr == _index.end())
+            {
+                ++_misses;
+                return std::shared_ptr<const result_set>();
+            }
+
+            ++_hits;
+            _entries.splice(_entries.begin(), _entries, itr->second);
+
+            return itr->second->results;
+        }
+
+        // caches results under key for ttl, 0 keeps it until it is evicted
+        // or invalidated, tags name the tables it was read from, a result
+        // set larger than the whole budget isn't kept
+        void insert(const std::string &key, std::shared_ptr<const result_set> results, std::chrono::milliseconds ttl,
+                    const std::vector<TSTR> &tags, unsigned long long epoch)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            std::unordered_map<std::string, entry_list::iterator>::iterator itr = _index.find(key);
+            entry e;
+
+            if(epoch != _epoch) return;
+
+            if(itr != _index.end()) erase(itr->second);
+
+            e.key = key;
+            e.results = results;
+            e.expires = ttl.count() > 0 ? clock::now() + ttl : clock::time_point::max();
+            e.bytes = key.size() + results->memory_usage() + results->spilled_bytes();
+            e.tags = tags;
+
+            if(e.bytes > _max_bytes) return;
+
+            trim(e.bytes);
+
+            _entries.push_front(e);
+            _index[key] = _entries.begin();
+            _bytes += e.bytes;
+
+            for(size_t i=0;i<tags.size();++i)
+                _tags[tags[i]].insert(key);
+        }
+
+        // drops every entry tagged with tag, returns how many there were
+        size_t invalidate(const TSTR &tag)
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            std::unordered_map<TSTR, std::unordered_set<std::string> >::iterator itr = _tags.find(tag);
+            std::vector<std::string> keys;
+
+            ++_epoch;
+
+            if(itr == _tags.end()) return 0;
+
+            keys.assign(itr->second.begin(), itr->second.end());
+
+            for(size_t i=0;i<keys.size();++i)
+                erase(_index[keys[i]]);
+
+            return keys.size();
+        }
+
+        // drops every entry
+        void clear()
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+
+            ++_epoch;
+            _entries.clear();
+            _index.clear();
+            _tags.clear();
+            _bytes = 0;
+        }
+
+        // number of finds that returned a result set and that didn't,
+        // and entries pushed out by the byte budget
+        unsigned long long hits() { std::lock_guard<std::mutex> lock(_lock); return _hits; }
+        unsigned long long misses() { std::lock_guard<std::mutex> lock(_lock); return _misses; }
+        unsigned long long evictions() { std::lock_guard<std::mutex> lock(_lock); return _evictions; }
+
+        // collapses every run of whitespace outside quotes and comments to
+        // one space and drops leading and trailing whitespace and
+        // semicolons, so the same query laid out differently shares an
+        // entry, comments are kept as written, a -- comment with its
+        // newline, so whatever they end up commenting out stays apart
+        static TSTR normalize(const TSTR &sql)
+        {
+            TSTR out;
+            TCHAR quote = 0;
+            bool space = false;
+            size_t i, end = sql.size(), stop;
+
+            while(end && (is_space(sql[end-1]) || sql[end-1] == _T(';'))) --end;
+
+            out.reserve(end);
+
+            for(i=0;i<end;++i)
+            {
+                TCHAR c = sql[i];
+
+                if(!quote && is_space(c))
+                {
+                    // the newline ending a -- comment already separates
+                    space = !out.empty() && out[out.size()-1] != _T('\n');
+                    continue;
+                }
+
+                if(!quote && i+1 < end && (c == _T('-') || c == _T('/')) && sql[i+1] == (c == _T('-') ? _T('-') : _T('*')))
+                {
+                    if(c == _T('-'))
+                    {
+                        stop = sql.find(_T('\n'), i);
+                        stop = stop == TSTR::npos ? end : stop + 1;
+                    }
+                    else
+                    {
+                        stop = sql.find(_T("*/"), i + 2);
+                        stop = stop == TSTR::npos ? end : stop + 2;
+                    }
+
+                    if(stop > end) stop = end;
+
+                    if(space) out += _T(' ');
+                    space = false;
+                    out.append(sql, i, stop - i);
+                    i = stop - 1;
+                    continue;
+                }
+
+                if(space) out += _T(' ');
+                space = false;
+                out += c;
+
+                if(quote && c == quote) quote = 0;
+                else if(!quote && (c == _T('\'') || c == _T('"'))) quote = c;
+            }
+
+            return out;
+        }
+
+    private:
+        struct entry
+        {
+            std::string key;
+            std::shared_ptr<const result_set> results;
+            clock::time_point expires;
+            size_t bytes;
+            std::vector<TSTR> tags;
+        };
+
+        typedef std::list<entry> entry_list;
+
+        std::mutex _lock;
+        size_t _max_bytes;
+        size_t _bytes;
+        // bumped by every invalidate() and clear()
+        unsigned long long _epoch;
+        unsigned long long _hits;
+        unsigned long long _misses;
+        unsigned long long _evictions;
+
+        // most recently used at the front
+        entry_list _entries;
+        std::unordered_map<std::string, entry_list::iterator> _index;
+        // tag => keys of the entries carrying it
+        std::unordered_map<TSTR, std::unordered_set<std::string> > _tags;
+
+        static bool is_space(TCHAR c)
+        {
+            return c == _T(' ') || c == _T('\t') || c == _T('\r') || c == _T('\n');
+        }
+
+        // evicts least recently used entries until bytes more fit
+        void trim(size_t bytes)
+        {
+            while(!_entries.empty() && _bytes + bytes > _max_bytes)
+            {
+                erase(--_entries.end());
+                ++_evictions;
+            }
+        }
+
+        void erase(entry_list::iterator e)
+        {
+            for(size_t i=0;i<e->tags.size();++i)
+            {
+                std::unordered_map<TSTR, std::unordered_set<std::string> >::iterator t = _tags.find(e->tags[i]);
+
+                if(t == _tags.end()) continue;
+
+                t->second.erase(e->key);
+                if(t->second.empty()) _tags.erase(t);
+            }
+
+            _bytes -= e->bytes;
+            _index.erase(e->key);
+            _entries.erase(e);
+        }
+};
+
+
+#endif
@@ -0,0 +1,653 @@
+/*
+  Name: result_set.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Columnar storage for materialized result sets
+               Every column is a single contiguous buffer with offsets
+               for variable-length values, the schema is shared by all
+               rows and rows are read through lightweight row_views
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef RESULT_SET_H
+#define RESULT_SET_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <type_traits>
+#include "table.h"
+#include "arena.h"
+
+
+/** UNICODE SUPPORT **/
+#if !defined(TCHAR)
+    #if defined(UNICODE) || defined(_UNICODE_)
+        #define TCHAR   wchar_t
+    #else
+        #define TCHAR   char
+    #endif
+#endif
+
+#if !defined(TSTR)
+    #if defined(UNICODE) || defined(_UNICODE_)
+        #define TSTR    std::wstring
+    #else
+        #define TSTR    std::string
+    #endif
+#endif
+
+#if !defined(TSTRVIEW)
+    #if defined(UNICODE) || defined(_UNICODE_)
+        #define TSTRVIEW    std::wstring_view
+    #else
+        #define TSTRVIEW    std::string_view
+    #endif
+#endif
+
+// Prototypes
+class result_schema;
+class result_column;
+class result_set;
+class row_view;
+
+// Describes a single column of a result set as reported by the driver,
+// c_type is the SQL_C_* type the values are stored as, lob marks long
+// columns that are read through SQLGetData rather than bound
+struct column_info
+{
+    TSTR name;
+    SQLSMALLINT sql_type;
+    SQLSMALLINT c_type;
+    SQLULEN size;
+    SQLSMALLINT decimals;
+    SQLSMALLINT nullable;
+    bool lob;
+};
+
+// Schemas hold the column descriptions once for a whole result set,
+// columns are numbered from 1 the same as ODBC
+class result_schema
+{
+    public:
+        // default constructor, empty schema
+        result_schema() { _fields.reset(new FIELDINDEX()); }
+        // default destructor
+        ~result_schema() {}
+
+        // appends a column description and indexes its name,
+        // duplicate names keep pointing at the first column
+        void add_column(const column_info &c)
+        {
+            _columns.push_back(c);
+
+            if(_index.insert(std::make_pair(c.name, _columns.size())).second)
+                _fields->insert(std::make_pair(c.name, _fields->size()));
+        }
+
+        // returns the number of columns
+        size_t columns() const { return _columns.size(); }
+
+        // returns the description of a column
+        const column_info &column(size_t col) const { return _columns.at(col-1); }
+
+        // returns the name of a column
+        const TSTR &name(size_t col) const { return _columns.at(col-1).name; }
+
+        // returns the column number for a name, 0 if there is no such
+        // column, duplicate names resolve to the first column
+        size_t find(const TSTR &name) const
+        {
+            FIELDINDEX::const_iterator it = _index.find(name);
+
+            return (it != _index.end()) ? it->second : 0;
+        }
+
+        // returns the name => position index shared with unordered_rows,
+        // positions skip duplicate names the same as add_field does
+        std::shared_ptr<const FIELDINDEX> field_index() const { return _fields; }
+
+    protected:
+        std::vector<column_info> _columns;
+        // name => column number
+        FIELDINDEX _index;
+        // name => unordered_row position
+        std::shared_ptr<FIELDINDEX> _fields;
+};
+
+// Columns store every value back to back in one buffer, the offsets
+// mark where each row starts so variable-length values need no
+// allocation of their own, rows are numbered from 0
+// The buffers come out of the owning result set's arena
+class result_column
+{
+    public:
+        // default constructor, empty column on the heap
+        result_column() { _offsets.push_back(0); }
+        // empty column allocating out of a
+        explicit result_column(arena *a)
+            : _data(a), _offsets(a), _nulls(a) { _offsets.push_back(0); }
+        // default destructor
+        ~result_column() {}
+
+        // appends a value of len bytes
+        void append(const void *value, size_t len)
+        {
+            _data.append((const unsigned char*)value, len);
+            _offsets.push_back(_data.size());
+            _nulls.push_back(0);
+        }
+
+        // appends a NULL value
+        void append_null()
+        {
+            _offsets.push_back(_data.size());
+            _nulls.push_back(1);
+        }
+
+        // returns a pointer to the start of a value
+        const unsigned char *data(size_t row) const { return _data.data() + _offsets[row]; }
+
+        // returns the length of a value in bytes
+        size_t length(size_t row) const { return _offsets[row+1] - _offsets[row]; }
+
+        // returns whether the value is NULL
+        bool is_null(size_t row) const { return _nulls[row] != 0; }
+
+        // returns the number of values stored
+        size_t size() const { return _nulls.size(); }
+
+        // returns the number of value bytes stored, NULLs count as 0
+        size_t bytes() const { return _data.size(); }
+
+        // returns the number of bytes held by the column
+        size_t memory_usage() const
+        {
+            return _data.capacity() + _offsets.capacity()*sizeof(size_t) + _nulls.capacity();
+        }
+
+        // drops every value
+        void clear()
+        {
+            _data.clear();
+            _offsets.clear();
+            _offsets.push_back(0);
+            _nulls.clear();
+        }
+
+    protected:
+        arena_array<unsigned char> _data;
+        arena_array<size_t> _offsets;
+        arena_array<unsigned char> _nulls;
+};
+
+// Formats a stored value as text the same way the driver would for
+// SQL_C_TCHAR, binary values are written as upper case hex
+inline TSTR format_value(SQLSMALLINT c_type, const void *value, size_t len)
+{
+    std::basic_ostringstream<TCHAR> out;
+    out.fill(_T('0'));
+
+    switch(c_type)
+    {
+        case SQL_C_SBIGINT:
+        {
+            SQLBIGINT v;
+            memcpy(&v, value, sizeof(v));
+            out << v;
+            break;
+        }
+        case SQL_C_DOUBLE:
+        {
+            SQLDOUBLE v;
+            memcpy(&v, value, sizeof(v));
+            out << std::setprecision(15) << v;
+            break;
+        }
+        case SQL_C_TYPE_DATE:
+        {
+            SQL_DATE_STRUCT v;
+            memcpy(&v, value, sizeof(v));
+            out << std::setw(4) << v.year << _T('-') << std::setw(2) << v.month
+                << _T('-') << std::setw(2) << v.day;
+            break;
+        }
+        case SQL_C_TYPE_TIME:
+        {
+            SQL_TIME_STRUCT v;
+            memcpy(&v, value, sizeof(v));
+            out << std::setw(2) << v.hour << _T(':') << std::setw(2) << v.minute
+                << _T(':') << std::setw(2) << v.second;
+            break;
+        }
+        case SQL_C_TYPE_TIMESTAMP:
+        {
+            SQL_TIMESTAMP_STRUCT v;
+            memcpy(&v, value, sizeof(v));
+            out << std::setw(4) << v.year << _T('-') << std::setw(2) << v.month
+                << _T('-') << std::setw(2) << v.day << _T(' ') << std::setw(2) << v.hour
+                << _T(':') << std::setw(2) << v.minute << _T(':') << std::setw(2) << v.second;
+            // fraction is in nanoseconds, trailing zeros are dropped
+            if(v.fraction)
+            {
+                SQLUINTEGER f = v.fraction;
+                int digits = 9;
+                while(f % 10 == 0) { f /= 10; --digits; }
+                out << _T('.') << std::setw(digits) << f;
+            }
+            break;
+        }
+        case SQL_C_BINARY:
+        {
+            const unsigned char *p = (const unsigned char*)value;
+            out << std::hex << std::uppercase;
+            for(size_t i=0;i<len;++i)
+                out << std::setw(2) << (unsigned int)p[i];
+            break;
+        }
+        default:
+            return TSTR((const TCHAR*)value, len/sizeof(TCHAR));
+    }
+
+    return out.str();
+}
+
+// Row views point at a single row of a result set without copying it,
+// they are only valid while the result set is unchanged
+class row_view
+{
+    public:
+        // default constructor, points at nothing
+        row_view() { _rs = 0; _row = 0; }
+        // points at a row position of a result set
+        row_view(const result_set *rs, size_t row) { _rs = rs; _row = row; }
+
+        // returns the row ID#, row IDs start at 1
+        unsigned long row_id() const { return (unsigned long)_row + 1; }
+
+        // returns the number of fields in the row
+        inline size_t num_fields() const;
+
+        // returns whether a field is NULL
+        inline bool is_null(size_t col) const;
+
+        // returns a copy of a field value, NULLs are returned empty
+        // typed values are formatted as text
+        inline TSTR value(size_t col) const;
+
+        // returns a field value without copying, the view points into the
+        // result set storage, NULLs and typed values are returned empty
+        inline TSTRVIEW view(size_t col) const;
+
+        // same as view(col)
+        TSTRVIEW operator[](size_t col) const { return view(col); }
+
+        // returns a field value as a number, typed values are read
+        // directly and text is parsed, NULLs are returned as 0
+        inline SQLBIGINT get_int(size_t col) const;
+        inline SQLDOUBLE get_double(size_t col) const;
+
+        // returns a date/time field, NULLs and text are returned zeroed
+        inline SQL_TIMESTAMP_STRUCT get_timestamp(size_t col) const;
+        inline SQL_DATE_STRUCT get_date(size_t col) const;
+        inline SQL_TIME_STRUCT get_time(size_t col) const;
+
+        // returns a field value as T, any arithmetic type, TSTR or one of
+        // the SQL date/time structs, e.g. r.get<int64_t>(1)
+        template<class T> T get(size_t col) const
+        {
+            if constexpr(std::is_integral<T>::value)
+                return (T)get_int(col);
+            else if constexpr(std::is_floating_point<T>::value)
+                return (T)get_double(col);
+            else if constexpr(std::is_same<T,SQL_TIMESTAMP_STRUCT>::value)
+                return get_timestamp(col);
+            else if constexpr(std::is_same<T,SQL_DATE_STRUCT>::value)
+                return get_date(col);
+            else if constexpr(std::is_same<T,SQL_TIME_STRUCT>::value)
+                return get_time(col);
+            else
+                return value(col);
+        }
+
+        // returns the field name of a column
+        inline const TSTR &name(size_t col) const;
+
+        // returns the column number of a field name through the shared
+        // schema, 0 if the name isn't in the result set
+        inline size_t index(const TSTR &name) const;
+
+        // name based versions of the accessors above, unknown
+        // names are treated the same as NULLs
+        bool is_null(const TSTR &name) const { size_t col = index(name); return !col || is_null(col); }
+        TSTR value(const TSTR &name) const { size_t col = index(name); return col ? value(col) : TSTR(); }
+        TSTRVIEW view(const TSTR &name) const { size_t col = index(name); return col ? view(col) : TSTRVIEW(); }
+        TSTRVIEW operator[](const TSTR &name) const { return view(name); }
+        template<class T> T get(const TSTR &name) const { size_t col = index(name); return col ? get<T>(col) : T(); }
+
+        // builds an unordered_row copy of the row
+        unordered_row to_row() const { return to_row(row_id()); }
+        // builds an unordered_row copy of the row with another row ID#
+        inline unordered_row to_row(unsigned long id) const;
+
+    protected:
+        const result_set *_rs;
+        size_t _row;
+};
+
+// Result sets own the schema and one result_column per column,
+// rows are appended a cell at a time and finished with end_row()
+class result_set
+{
+    public:
+        // default constructor, empty result set
+        result_set() : _arena(new arena()) { _schema.reset(new result_schema()); _rows = 0; }
+        // copies the rows into an arena of its own with the same budget
+        result_set(const result_set &other) : _arena(new arena())
+        {
+            _rows = 0;
+            _arena->set_budget(other._arena->budget());
+            reset(other._schema);
+            append_rows(other, 0);
+        }
+        result_set &operator=(const result_set &other)
+        {
+            if(this != &other)
+            {
+                reset(other._schema);
+                append_rows(other, 0);
+            }
+
+            return *this;
+        }
+        // default destructor
+        ~result_set() {}
+
+        // drops all rows and sets up empty columns for a new schema,
+        // the old columns' storage goes back to the arena in one go
+        void reset(std::shared_ptr<const result_schema> schema)
+        {
+            _schema = schema;
+            _columns.clear();
+            _arena->reset();
+            _columns.assign(_schema->columns(), result_column(_arena.get()));
+            _rows = 0;
+        }
+
+        // drops all rows but keeps the schema and the column storage
+        // so the next rows can be appended without reallocating
+        void clear_rows()
+        {
+            for(size_t i=0;i<_columns.size();++i)
+                _columns[i].clear();
+            _rows = 0;
+        }
+
+        // drops all rows and the schema
+        void clear() { reset(std::shared_ptr<const result_schema>(new result_schema())); }
+
+        // trades rows, schema and storage with other without copying
+        void swap(result_set &other)
+        {
+            std::swap(_arena, other._arena);
+            std::swap(_schema, other._schema);
+            std::swap(_columns, other._columns);
+            std::swap(_rows, other._rows);
+        }
+
+        // appends a value to a column of the row being built
+        void append(size_t col, const void *value, size_t len) { _columns[col-1].append(value, len); }
+
+        // appends a NULL to a column of the row being built
+        void append_null(size_t col) { _columns[col-1].append_null(); }
+
+        // finishes the row being built
+        void end_row() { ++_rows; }
+
+        // copies the rows of src from row position from onwards onto
+        // the end, src must have the same columns
+        void append_rows(const result_set &src, size_t from)
+        {
+            for(size_t row=from;row<src.rows();++row)
+            {
+                for(size_t col=1;col<=_columns.size();++col)
+                {
+                    const result_column &c = src.column(col);
+
+                    if(c.is_null(row))
+                        _columns[col-1].append_null();
+                    else
+                        _columns[col-1].append(c.data(row), c.length(row));
+                }
+
+                ++_rows;
+            }
+        }
+
+        // returns the number of rows
+        size_t rows() const { return _rows; }
+
+        // returns the number of columns
+        size_t columns() const { return _columns.size(); }
+
+        // returns the shared schema
+        const result_schema &schema() const { return *_schema; }
+        std::shared_ptr<const result_schema> schema_ptr() const { return _schema; }
+
+        // returns the storage for a column
+        const result_column &column(size_t col) const { return _columns.at(col-1); }
+
+        // returns a view of a row, row IDs start at 1
+        row_view row(size_t row_id) const { return row_view(this, row_id-1); }
+
+        // forward iterator handing out a row_view per row, allows
+        // for(row_view r : results) without copying any row data
+        class const_iterator
+        {
+            public:
+                const_iterator(const result_set *rs, size_t row) { _rs = rs; _row = row; }
+
+                row_view operator*() const { return row_view(_rs, _row); }
+                const_iterator &operator++() { ++_row; return *this; }
+                const_iterator operator++(int) { const_iterator tmp = *this; ++_row; return tmp; }
+                bool operator==(const const_iterator &rhs) const { return _row == rhs._row && _rs == rhs._rs; }
+                bool operator!=(const const_iterator &rhs) const { return !(*this == rhs); }
+
+            protected:
+                const result_set *_rs;
+                size_t _row;
+        };
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, _rows); }
+
+        // returns the number of allocations the columns made since the
+        // result set was created and how many of those reached the heap
+        size_t allocations() const { return _arena->allocations(); }
+        size_t heap_allocations() const { return _arena->heap_allocations(); }
+
+        // returns the number of bytes held by the result set on the heap,
+        // including buffers the columns have outgrown until the arena is
+        // reset unless a budget is set, and the number held in the spill
+        // file past the budget
+        size_t memory_usage() const { return _arena->bytes_heap(); }
+        size_t spilled_bytes() const { return _arena->bytes_spilled(); }
+
+        // once the storage on the heap reaches bytes, the column buffers
+        // grow into a temporary memory mapped file instead, which the OS
+        // pages to disk as it needs to, rows read the same either way,
+        // 0 (the default) keeps everything on the heap, with a budget the
+        // buffers the columns outgrow are freed as they go, see arena.h
+        void set_memory_budget(size_t bytes) { _arena->set_budget(bytes); }
+        size_t memory_budget() const { return _arena->budget(); }
+
+        // returns the number of value bytes stored across every column
+        size_t bytes() const
+        {
+            size_t n = 0;
+
+            for(size_t i=0;i<_columns.size();++i)
+                n += _columns[i].bytes();
+
+            return n;
+        }
+
+    protected:
+        // declared first so the columns are destroyed before their storage
+        std::unique_ptr<arena> _arena;
+        std::shared_ptr<const result_schema> _schema;
+        std::vector<result_column> _columns;
+        size_t _rows;
+};
+
+
+size_t row_view::num_fields() const
+{
+    return _rs ? _rs->columns() : 0;
+}
+
+bool row_view::is_null(size_t col) const
+{
+    return _rs->column(col).is_null(_row);
+}
+
+TSTR row_view::value(size_t col) const
+{
+    const result_column &c = _rs->column(col);
+
+    if(c.is_null(_row)) return TSTR();
+
+    return format_value(_rs->schema().column(col).c_type, c.data(_row), c.length(_row));
+}
+
+TSTRVIEW row_view::view(size_t col) const
+{
+    const result_column &c = _rs->column(col);
+
+    if(c.is_null(_row) || _rs->schema().column(col).c_type != SQL_C_TCHAR) return TSTRVIEW();
+
+    return TSTRVIEW((const TCHAR*)c.data(_row), c.length(_row)/sizeof(TCHAR));
+}
+
+SQLBIGINT row_view::get_int(size_t col) const
+{
+    const result_column &c = _rs->column(col);
+    SQLBIGINT i = 0;
+    SQLDOUBLE d;
+
+    if(c.is_null(_row)) return 0;
+
+    switch(_rs->schema().column(col).c_type)
+    {
+        case SQL_C_SBIGINT: memcpy(&i, c.data(_row), sizeof(i)); return i;
+        case SQL_C_DOUBLE: memcpy(&d, c.data(_row), sizeof(d)); return (SQLBIGINT)d;
+        default:
+        {
+            std::basic_istringstream<TCHAR> in(value(col));
+            in >> i;
+            return i;
+        }
+    }
+}
+
+SQLDOUBLE row_view::get_double(size_t col) const
+{
+    const result_column &c = _rs->column(col);
+    SQLBIGINT i;
+    SQLDOUBLE d = 0;
+
+    if(c.is_null(_row)) return 0;
+
+    switch(_rs->schema().column(col).c_type)
+    {
+        case SQL_C_SBIGINT: memcpy(&i, c.data(_row), sizeof(i)); return (SQLDOUBLE)i;
+        case SQL_C_DOUBLE: memcpy(&d, c.data(_row), sizeof(d)); return d;
+        default:
+        {
+            std::basic_istringstream<TCHAR> in(value(col));
+            in >> d;
+            return d;
+        }
+    }
+}
+
+SQL_TIMESTAMP_STRUCT row_view::get_timestamp(size_t col) const
+{
+    const result_column &c = _rs->column(col);
+    SQL_TIMESTAMP_STRUCT ts;
+    SQL_DATE_STRUCT d;
+    SQL_TIME_STRUCT t;
+
+    memset(&ts, 0, sizeof(ts));
+    if(c.is_null(_row)) return ts;
+
+    switch(_rs->schema().column(col).c_type)
+    {
+        case SQL_C_TYPE_TIMESTAMP:
+            memcpy(&ts, c.data(_row), sizeof(ts));
+            break;
+        case SQL_C_TYPE_DATE:
+            memcpy(&d, c.data(_row), sizeof(d));
+            ts.year = d.year; ts.month = d.month; ts.day = d.day;
+            break;
+        case SQL_C_TYPE_TIME:
+            memcpy(&t, c.data(_row), sizeof(t));
+            ts.hour = t.hour; ts.minute = t.minute; ts.second = t.second;
+            break;
+    }
+
+    return ts;
+}
+
+SQL_DATE_STRUCT row_view::get_date(size_t col) const
+{
+    SQL_TIMESTAMP_STRUCT ts = get_timestamp(col);
+    SQL_DATE_STRUCT d;
+
+    d.year = ts.year; d.month = ts.month; d.day = ts.day;
+    return d;
+}
+
+SQL_TIME_STRUCT row_view::get_time(size_t col) const
+{
+    SQL_TIMESTAMP_STRUCT ts = get_timestamp(col);
+    SQL_TIME_STRUCT t;
+
+    t.hour = ts.hour; t.minute = ts.minute; t.second = ts.second;
+    return t;
+}
+
+const TSTR &row_view::name(size_t col) const
+{
+    return _rs->schema().name(col);
+}
+
+size_t row_view::index(const TSTR &name) const
+{
+    return _rs ? _rs->schema().find(name) : 0;
+}
+
+// NULLs are written as "NULL" to match the old row based result sets
+unordered_row row_view::to_row(unsigned long id) const
+{
+    unordered_row r(id, _rs->schema().field_index());
+
+    for(size_t col=1;col<=num_fields();++col)
+    {
+        if(is_null(col))
+            r.add_field(field(name(col),_T("NULL")));
+        else
+            r.add_field(field(name(col),value(col)));
+    }
+
+    return r;
+}
+
+
+#endif
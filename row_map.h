@@ -0,0 +1,182 @@
+/*
+  Name: row_map.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Compile time mapping of result columns onto the members of
+               a plain struct, used by statement::fetch_rows<T>() to bind
+               the columns row-wise straight into a std::vector<T>
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef ROW_MAP_H
+#define ROW_MAP_H
+
+#include <type_traits>
+#include <vector>
+#include "bind.h"
+
+// A struct is mapped by specialising row_mapping with a map() that names
+// the column of every member to fetch, by name or number from 1
+//     struct trade { SQLBIGINT id; char symbol[16]; double price; SQLLEN price_ind; };
+//
+//     template<> struct row_mapping<trade>
+//     {
+//         static void map(row_mapper<trade> &m)
+//         {
+//             m.column(_T("id"), &trade::id)
+//              .column(_T("symbol"), &trade::symbol)
+//              .column(3, &trade::price, &trade::price_ind);
+//         }
+//     };
+// A SQLLEN indicator member receives the length or SQL_NULL_DATA, members
+// without one are zeroed on NULL, unmapped members are left as constructed
+template<class T>
+struct row_mapping;
+
+// C type and buffer width a member is fetched as, fixed size types take
+// the C type they are bound with as parameters, character arrays are
+// fetched as terminated text and unsigned char arrays as raw bytes
+template<class M, class Enable = void>
+struct column_traits
+{
+	static SQLSMALLINT c_type() { return param_traits<M>::c_type(); }
+	static SQLLEN width() { return sizeof(M); }
+};
+
+template<size_t N>
+struct column_traits<char[N]>
+{
+	static SQLSMALLINT c_type() { return SQL_C_CHAR; }
+	static SQLLEN width() { return N; }
+};
+
+template<size_t N>
+struct column_traits<SQLWCHAR[N]>
+{
+	static SQLSMALLINT c_type() { return SQL_C_WCHAR; }
+	static SQLLEN width() { return N*sizeof(SQLWCHAR); }
+};
+
+template<size_t N>
+struct column_traits<unsigned char[N]>
+{
+	static SQLSMALLINT c_type() { return SQL_C_BINARY; }
+	static SQLLEN width() { return N; }
+};
+
+// one mapped member, col is 0 while it is still to be looked up by name,
+// offsets are from the start of the struct and indicator is npos when
+// the member has no indicator of its own
+struct row_member
+{
+	SQLUSMALLINT col;
+	TSTR name;
+	SQLSMALLINT c_type;
+	size_t offset;
+	SQLLEN width;
+	size_t indicator;
+};
+
+// every mapped member of a struct, row_size is the struct's size and
+// the stride between rows
+struct row_layout
+{
+	size_t row_size;
+	std::vector<row_member> members;
+};
+
+// Collects the members row_mapping<T>::map() lists into a layout
+template<class T>
+class row_mapper
+{
+	public:
+		row_mapper(row_layout &layout) : _layout(layout), _probe() {}
+
+		template<class M>
+		row_mapper &column(SQLUSMALLINT col, M T::*member) { return add(col, TSTR(), member, NULL); }
+		template<class M>
+		row_mapper &column(const TSTR &name, M T::*member) { return add(0, name, member, NULL); }
+		template<class M>
+		row_mapper &column(SQLUSMALLINT col, M T::*member, SQLLEN T::*indicator) { return add(col, TSTR(), member, indicator); }
+		template<class M>
+		row_mapper &column(const TSTR &name, M T::*member, SQLLEN T::*indicator) { return add(0, name, member, indicator); }
+
+	private:
+		row_layout &_layout;
+		// member offsets are measured on a value initialised instance
+		T _probe;
+
+		size_t offset_of(const void *member)
+		{
+			return (const unsigned char*)member - (const unsigned char*)&_probe;
+		}
+
+		template<class M>
+		row_mapper &add(SQLUSMALLINT col, const TSTR &name, M T::*member, SQLLEN T::*indicator)
+		{
+			row_member m;
+
+			m.col = col;
+			m.name = name;
+			m.c_type = column_traits<M>::c_type();
+			m.offset = offset_of(&(_probe.*member));
+			m.width = column_traits<M>::width();
+			m.indicator = indicator ? offset_of(&(_probe.*indicator)) : (size_t)-1;
+
+			_layout.members.push_back(m);
+
+			return *this;
+		}
+};
+
+// returns the layout of T, built on first use and shared from then on
+template<class T>
+const row_layout &row_layout_of()
+{
+	static_assert(std::is_trivially_copyable<T>::value && std::is_default_constructible<T>::value,
+				  "fetch_rows() needs a trivially copyable, default constructible struct");
+
+	static const row_layout layout = []
+	{
+		row_layout l;
+		row_mapper<T> m(l);
+
+		l.row_size = sizeof(T);
+		row_mapping<T>::map(m);
+
+		return l;
+	}();
+
+	return layout;
+}
+
+// Grows the caller's array of structs for fetch_rows(), resize() returns
+// where the array now starts as it may have moved
+class row_sink
+{
+	public:
+		virtual ~row_sink() {}
+
+		virtual unsigned char *resize(size_t rows) = 0;
+};
+
+template<class T>
+class vector_row_sink : public row_sink
+{
+	public:
+		vector_row_sink(std::vector<T> &rows) : _rows(rows) {}
+
+		unsigned char *resize(size_t rows)
+		{
+			_rows.resize(rows);
+			return (unsigned char*)_rows.data();
+		}
+
+	private:
+		std::vector<T> &_rows;
+};
+
+
+#endif
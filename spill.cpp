@@ -0,0 +1,196 @@
+#include "headers\odbc.h"
+#include <cstdlib>
+#if !defined(_WIN32)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+#endif
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+spill_file::spill_file()
+{
+	_file = -1;
+	_failed = false;
+	_size = 0;
+	_mapped = 0;
+}
+
+spill_file::~spill_file()
+{
+	clear();
+
+	if(_file == -1) return;
+
+#if defined(_WIN32)
+	CloseHandle((HANDLE)_file);
+#else
+	close((int)_file);
+#endif
+}
+
+// the file only ever grows by whole blocks at its end, so each block
+// maps at the old size, which is a multiple of the granularity
+void *spill_file::map(size_t bytes)
+{
+	view v;
+
+	if(!open()) return NULL;
+
+	bytes = (bytes + granularity - 1) / granularity * granularity;
+
+#if defined(_WIN32)
+	unsigned long long end = (unsigned long long)_size + bytes;
+	HANDLE mapping = CreateFileMapping((HANDLE)_file, NULL, PAGE_READWRITE, (DWORD)(end >> 32), (DWORD)end, NULL);
+
+	if(!mapping) return NULL;
+
+	v.data = MapViewOfFile(mapping, FILE_MAP_WRITE, (DWORD)((unsigned long long)_size >> 32), (DWORD)_size, bytes);
+	// the view keeps the mapping alive on its own
+	CloseHandle(mapping);
+
+	if(!v.data) return NULL;
+#else
+	// the space is taken up front so a full disk fails here rather than
+	// with SIGBUS on the first write to the block
+#if defined(__linux__)
+	if(posix_fallocate((int)_file, (off_t)_size, (off_t)bytes) != 0) return NULL;
+#else
+	if(ftruncate((int)_file, (off_t)(_size + bytes)) != 0) return NULL;
+#endif
+
+	v.data = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, (int)_file, (off_t)_size);
+
+	if(v.data == MAP_FAILED)
+	{
+		if(ftruncate((int)_file, (off_t)_size) != 0) _failed = true;
+		return NULL;
+	}
+#endif
+
+	v.size = bytes;
+	v.offset = _size;
+	_views.push_back(v);
+	_size += bytes;
+	_mapped += bytes;
+
+	return v.data;
+}
+
+// Windows keeps the space until clear(), punching a hole needs the file
+// to be sparse, elsewhere the range is punched out where supported
+void spill_file::unmap(void *data)
+{
+	size_t i;
+
+	for(i=0;i<_views.size();++i)
+		if(_views[i].data == data) break;
+
+	if(i == _views.size()) return;
+
+#if defined(_WIN32)
+	UnmapViewOfFile(_views[i].data);
+#else
+	munmap(_views[i].data, _views[i].size);
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+	fallocate((int)_file, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)_views[i].offset, (off_t)_views[i].size);
+#endif
+#endif
+
+	_mapped -= _views[i].size;
+	_views[i] = _views.back();
+	_views.pop_back();
+}
+
+void spill_file::clear()
+{
+	for(size_t i=0;i<_views.size();++i)
+	{
+#if defined(_WIN32)
+		UnmapViewOfFile(_views[i].data);
+#else
+		munmap(_views[i].data, _views[i].size);
+#endif
+	}
+
+	_views.clear();
+	_mapped = 0;
+
+	if(_file != -1 && _size)
+	{
+#if defined(_WIN32)
+		LARGE_INTEGER zero;
+		zero.QuadPart = 0;
+		if(!SetFilePointerEx((HANDLE)_file, zero, NULL, FILE_BEGIN) || !SetEndOfFile((HANDLE)_file)) _failed = true;
+#else
+		if(ftruncate((int)_file, 0) != 0) _failed = true;
+#endif
+	}
+
+	_size = 0;
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+// a failed create or truncate isn't retried, the arena goes back to
+// the heap for the rest of the spill file's life
+bool spill_file::open()
+{
+	std::string dir = ODBC_SPILL_DIR;
+
+	if(_failed) return false;
+	if(_file != -1) return true;
+
+#if defined(_WIN32)
+	char path[MAX_PATH];
+	char name[MAX_PATH];
+	HANDLE h;
+
+	if(dir.empty())
+	{
+		if(!GetTempPathA(MAX_PATH, path)) { _failed = true; return false; }
+		dir = path;
+	}
+
+	if(!GetTempFileNameA(dir.c_str(), "odb", 0, name)) { _failed = true; return false; }
+
+	h = CreateFileA(name, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+					FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+
+	if(h == INVALID_HANDLE_VALUE)
+	{
+		DeleteFileA(name);
+		_failed = true;
+		return false;
+	}
+
+	_file = (intptr_t)h;
+#else
+	const char *tmp = getenv("TMPDIR");
+	std::vector<char> path;
+	int fd;
+
+	if(dir.empty()) dir = (tmp && *tmp) ? tmp : "/tmp";
+
+	dir += "/odbc_spill_XXXXXX";
+	path.assign(dir.begin(), dir.end());
+	path.push_back(0);
+
+	fd = mkstemp(&path[0]);
+
+	if(fd == -1)
+	{
+		_failed = true;
+		return false;
+	}
+
+	unlink(&path[0]);
+	_file = fd;
+#endif
+
+	return true;
+}
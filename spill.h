@@ -0,0 +1,77 @@
+/*
+  Name: spill.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Temporary file mapped into memory a block at a time, the
+               arena takes its blocks from one once a result set has used
+               up its memory budget so the rows past it are paged to disk
+               by the OS instead of held on the heap
+*/
+
+#ifndef SPILL_H
+#define SPILL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// directory spill files are created in, empty for the system temp
+// directory, TMPDIR or /tmp outside Windows
+#if !defined(ODBC_SPILL_DIR)
+    #define ODBC_SPILL_DIR ""
+#endif
+
+// The file is deleted as soon as it is created, or opened delete on
+// close on Windows, so nothing is left behind if the process dies
+// Not thread safe, a spill file belongs to a single arena
+class spill_file
+{
+    public:
+        spill_file();
+        // unmaps every block and closes the file
+        ~spill_file();
+
+        spill_file(const spill_file&) = delete;
+        spill_file &operator=(const spill_file&) = delete;
+
+        // grows the file by bytes and maps the new part, NULL if the
+        // file couldn't be created, grown or mapped
+        void *map(size_t bytes);
+        // unmaps the block map() returned as data and gives its disk space
+        // back where the file system can punch holes, the file keeps its
+        // size so the blocks after it stay where they are
+        void unmap(void *data);
+        // unmaps every block and truncates the file, it is kept open
+        // for the next result set
+        void clear();
+
+        // returns the number of bytes mapped
+        size_t size() const { return _mapped; }
+
+        // mapped blocks are this many bytes apart in the file, the
+        // allocation granularity of Windows and a multiple of the page size
+        static const size_t granularity = 65536;
+
+    private:
+        struct view
+        {
+            void *data;
+            size_t size;
+            size_t offset;
+        };
+
+        // file descriptor or Windows HANDLE, -1 until opened
+        intptr_t _file;
+        bool _failed;
+        // length of the file and bytes of it currently mapped
+        size_t _size;
+        size_t _mapped;
+        std::vector<view> _views;
+
+        // creates the file on the first map()
+        bool open();
+};
+
+
+#endif
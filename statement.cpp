@@ -0,0 +1,1593 @@
+#include "headers\odbc.h"
+
+/*****************
+* PUBLIC METHODS *
+******************/
+
+statement::statement()
+{
+	_conn = NULL;
+	_owner = NULL;
+	_hstmt = NULL;
+	_rowset_size = 1;
+	_typed = false;
+	_stream_lobs = false;
+	_prefetch = 0;
+	_memory_budget = 0;
+
+	init();
+}
+
+statement::statement(odbc &conn)
+{
+	_conn = NULL;
+	_owner = &conn;
+	_hstmt = NULL;
+	_rowset_size = conn._rowset_size;
+	_typed = conn._typed;
+	_stream_lobs = conn._stream_lobs;
+	_prefetch = conn._prefetch;
+	_memory_budget = conn._memory_budget;
+	_result_cache = conn._result_cache;
+
+	init();
+
+	// kept even when conn isn't connected yet, connect() attaches it
+	conn._statements.push_back(this);
+	attach(conn);
+}
+
+statement::~statement()
+{
+	if(_owner)
+	{
+		std::vector<statement*> &list = _owner->_statements;
+		list.erase(std::remove(list.begin(), list.end(), this), list.end());
+	}
+
+	detach();
+}
+
+bool statement::is_open()
+{
+	return ready();
+}
+
+SQLHANDLE statement::handle()
+{
+	return _hstmt;
+}
+
+SQLRETURN statement::last_status()
+{
+	return _rc;
+}
+
+TSTR statement::last_error()
+{
+	return _err;
+}
+
+TSTR statement::last_state()
+{
+	return _diag.last().state;
+}
+
+std::vector<diag_record> statement::diagnostics()
+{
+	return _diag.records();
+}
+
+void statement::clear_diagnostics()
+{
+	_diag.clear();
+}
+
+// prepares the statement and then loops through a vector of params
+// and binds each param in the vector, important to note that the
+// number of params defined must all be bound, it stops at the first
+// parameter that fails to bind and an empty list binds nothing
+bool statement::prepare_and_bind(TSTR sql_stmt,std::vector<param> params)
+{
+	std::vector<param>::iterator it;
+
+	try
+	{
+		if(prepare(sql_stmt))
+		{
+			it=params.begin();
+
+			while(it!=params.end())
+			{
+				if(!bind_param(it->col, it->val, it->type, it->size, it->decimals))
+					return false;
+				++it;
+			}
+
+			return true;
+		}
+		else
+            return false;
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// Prepares the statement and if successful stores the SQL statement for re-use and for binding
+bool statement::prepare(TSTR sql_stmt)
+{
+	try
+	{
+		if(ready())
+		{
+			metrics_timer timer(metrics(), metric_prepare);
+
+			if(_stmt_cache.capacity()) return prepare_cached(sql_stmt);
+
+			_rc = SQLPrepare(_hstmt, (SQLTCHAR*)sql_stmt.c_str(), sql_stmt.size());
+			_conn->_metrics.add(metric_driver_calls);
+
+			if(!SQL_SUCCEEDED(_rc))
+			{
+				error(_T("prepare()"),_hstmt, SQL_HANDLE_STMT);
+				return false;
+			}
+			else
+			{
+				_sql_stmt = sql_stmt;
+				return true;
+			}
+		}
+		else
+		{
+			_err = _T("Failed to prepare statement, connection hasn't been established yet");
+			return false;
+		}
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// Binds a parameter to a prepared SQL statement, the value is copied
+// into the column's buffer which is reused by the next bind
+bool statement::bind_param(short col, TSTR val, short sql_field_type, SQLULEN col_size ,short decimal_pts)
+{
+	try
+	{
+		if(bind_buffer(col, SQL_C_TCHAR, sql_field_type, col_size, decimal_pts,
+					   val.data(), val.size()*sizeof(TCHAR), false, _T("bind_param()")))
+			return true;
+
+		if(ready() && _sql_stmt.size())
+			_err += _T(", unable to bind PARAM: ") + val;
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// packs each param_array into one contiguous buffer so the
+// driver can walk every parameter set in a single SQLExecute
+bool statement::execute_batch(std::vector<param_array> &params)
+{
+	std::vector<std::vector<TCHAR> > buffers(params.size());
+	std::vector<std::vector<SQLLEN> > lengths(params.size());
+	SQLULEN sets = params.empty() ? 0 : params[0].vals.size();
+	size_t i, set;
+
+	try
+	{
+		if(!ready() || !_sql_stmt.size())
+		{
+			_err = _T("Failed to execute batch, no statement has been prepared");
+			return false;
+		}
+
+		for(i=0;i<params.size();++i)
+		{
+			param_array &p = params[i];
+			size_t width = 1;
+
+			if(p.vals.size() != sets)
+			{
+				_err = _T("Failed to execute batch, parameter arrays differ in length");
+				reset_params();
+				return false;
+			}
+
+			for(set=0;set<sets;++set)
+				if(p.vals[set].size()+1 > width) width = p.vals[set].size()+1;
+
+			buffers[i].assign(width*sets, SZ_TCHAR);
+			lengths[i].resize(sets);
+
+			for(set=0;set<sets;++set)
+			{
+				p.vals[set].copy(&buffers[i][set*width], p.vals[set].size());
+				lengths[i][set] = p.vals[set].size()*sizeof(TCHAR);
+			}
+
+			_rc = SQLBindParameter(_hstmt, p.col, SQL_PARAM_INPUT, SQL_C_TCHAR, p.type,
+								   p.size, p.decimals, &buffers[i][0], width*sizeof(TCHAR), &lengths[i][0]);
+
+			if(!SQL_SUCCEEDED(_rc))
+			{
+				error(_T("execute_batch()"),_hstmt, SQL_HANDLE_STMT);
+				reset_params();
+				return false;
+			}
+		}
+
+		_rc = SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAM_BIND_TYPE, (SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0);
+
+		return execute_sets(sets);
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// the driver steps each binding by row_size bytes per parameter set
+bool statement::execute_batch(std::vector<param_binding> &bindings, SQLULEN row_size, SQLULEN sets)
+{
+	std::vector<param_binding>::iterator it;
+
+	try
+	{
+		if(!ready() || !_sql_stmt.size())
+		{
+			_err = _T("Failed to execute batch, no statement has been prepared");
+			return false;
+		}
+
+		for(it=bindings.begin(); it!=bindings.end(); ++it)
+		{
+			_rc = SQLBindParameter(_hstmt, it->col, SQL_PARAM_INPUT, it->c_type, it->type,
+								   it->size, it->decimals, it->value, it->buffer_len, it->indicator);
+
+			if(!SQL_SUCCEEDED(_rc))
+			{
+				error(_T("execute_batch()"),_hstmt, SQL_HANDLE_STMT);
+				reset_params();
+				return false;
+			}
+		}
+
+		_rc = SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAM_BIND_TYPE, (SQLPOINTER)row_size, 0);
+
+		return execute_sets(sets);
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+std::vector<SQLUSMALLINT> statement::batch_status()
+{
+	return _param_status;
+}
+
+SQLULEN statement::batch_processed()
+{
+	return _params_processed;
+}
+
+void statement::free_statement()
+{
+    _fields = 0;
+    _rows = 0;
+
+    _schema.reset(new result_schema());
+	_table.clear();
+
+	_cursor.close();
+	_stmt_rowset_size = 0;
+
+	// cached handles stay prepared, only the plain handle is dropped
+	use_plain_statement();
+
+	if(_hstmt) _rc = SQLFreeStmt(_hstmt, SQL_DROP);
+	_hstmt = NULL;
+	forget_params();
+
+	if(!_conn)
+	{
+		_rc = SQL_INVALID_HANDLE;
+		return;
+	}
+
+	_rc = SQLAllocStmt(_conn->_hdbc, &_hstmt);
+
+	if(SQL_SUCCEEDED(_rc))
+	{
+        _sql_stmt.clear();
+        _bound = false;
+        _built = false;
+        _executed = false;
+	}
+	else
+		_hstmt = NULL;
+}
+
+// executes a prepared and bound statement
+bool statement::execute()
+{
+	try
+	{
+		if(ready())
+		{
+			// closes the cursor of the last run so a prepared
+			// statement can be executed again with new parameters
+			metrics_timer timer(metrics(), metric_execute);
+
+			_cursor.close();
+			SQLFreeStmt(_hstmt, SQL_CLOSE);
+			_rc = SQLExecute(_hstmt);
+			_conn->_metrics.add(metric_driver_calls, 2);
+
+			if(!SQL_SUCCEEDED(_rc))
+			{
+				error(_T("execute()"),_hstmt, SQL_HANDLE_STMT);
+				return false;
+			}
+
+			_built = false;
+			_failed_rows = 0;
+			_executed = true;
+			return true;
+		}
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+bool statement::execute_direct(TSTR sql_stmt)
+{
+	try
+	{
+		if(ready())
+		{
+			metrics_timer timer(metrics(), metric_execute);
+
+			_cursor.close();
+			use_plain_statement();
+			_rc = SQLExecDirect(_hstmt,(SQLTCHAR*)sql_stmt.c_str(), SQL_NTS);
+			_conn->_metrics.add(metric_driver_calls);
+
+			if(!SQL_SUCCEEDED(_rc))
+			{
+				error(_T("execute_direct()"),_hstmt, SQL_HANDLE_STMT);
+				return false;
+			}
+
+			_built = false;
+			_failed_rows = 0;
+			_executed = true;
+			return true;
+		}
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// the promise is shared with the executor so the future survives
+// whichever thread finishes the call
+std::future<bool> statement::execute_async()
+{
+	std::shared_ptr<std::promise<bool> > done(new std::promise<bool>());
+	std::future<bool> ret = done->get_future();
+	SQLHANDLE hstmt = _hstmt;
+
+	if(!ready())
+	{
+		done->set_value(false);
+		return ret;
+	}
+
+	_cursor.close();
+	SQLFreeStmt(_hstmt, SQL_CLOSE);
+
+	if(!begin_async())
+	{
+		async_executor::shared().run([this, done]{ done->set_value(execute()); });
+		return ret;
+	}
+
+	odbc_metrics *m = metrics();
+	odbc_metrics::clock::time_point start;
+
+	if(m->enabled()) start = odbc_metrics::clock::now();
+
+	// every poll re-issues the call, so each one counts
+	async_executor::shared().poll(
+		[hstmt, m]{ m->add(metric_driver_calls); return SQLExecute(hstmt); },
+		[this, done, m, start](SQLRETURN rc)
+		{
+			if(m->enabled()) m->record(metric_execute, odbc_metrics::clock::now() - start);
+			done->set_value(end_async(rc, _T("execute_async()")));
+		});
+
+	return ret;
+}
+
+// the SQL text is held by the poll call itself so every
+// re-issue passes the driver the same buffer
+std::future<bool> statement::execute_direct_async(TSTR sql_stmt)
+{
+	std::shared_ptr<std::promise<bool> > done(new std::promise<bool>());
+	std::shared_ptr<TSTR> text(new TSTR(sql_stmt));
+	std::future<bool> ret = done->get_future();
+	SQLHANDLE hstmt;
+
+	if(!ready())
+	{
+		done->set_value(false);
+		return ret;
+	}
+
+	_cursor.close();
+	use_plain_statement();
+	hstmt = _hstmt;
+
+	if(!begin_async())
+	{
+		async_executor::shared().run([this, done, text]{ done->set_value(execute_direct(*text)); });
+		return ret;
+	}
+
+	odbc_metrics *m = metrics();
+	odbc_metrics::clock::time_point start;
+
+	if(m->enabled()) start = odbc_metrics::clock::now();
+
+	async_executor::shared().poll(
+		[hstmt, text, m]{ m->add(metric_driver_calls); return SQLExecDirect(hstmt, (SQLTCHAR*)text->c_str(), SQL_NTS); },
+		[this, done, m, start](SQLRETURN rc)
+		{
+			if(m->enabled()) m->record(metric_execute, odbc_metrics::clock::now() - start);
+			done->set_value(end_async(rc, _T("execute_direct_async()")));
+		});
+
+	return ret;
+}
+
+// fetching is many short driver calls, so it goes to a worker
+// rather than through the poller
+std::future<const result_set&> statement::results_async()
+{
+	std::shared_ptr<std::promise<const result_set&> > done(new std::promise<const result_set&>());
+	std::future<const result_set&> ret = done->get_future();
+
+	if(_built || !_executed)
+	{
+		done->set_value(results());
+		return ret;
+	}
+
+	async_executor::shared().run([this, done]{ done->set_value(results()); });
+
+	return ret;
+}
+
+// keeps returning each row of a built result set table until
+// the internal pointer reaches the end
+bool statement::fetch(unordered_row &r)
+{
+	if(!_built) {build_result_set();} else if(!_fetching) {reset_iterator();}
+
+	if(_fetch_pos < _table.rows())
+    {
+        _fetching = true;
+        r = _table.row(++_fetch_pos).to_row();
+    }
+    else
+    {
+        _fetch_pos = 0;
+        _fetching = false;
+        return false;
+    }
+
+    return true;
+}
+
+bool statement::fetch(unordered_row *&r)
+{
+	if(!_built) {build_result_set();} else if(!_fetching) {reset_iterator();}
+
+	if(_fetch_pos < _table.rows())
+    {
+        _fetching = true;
+        _current = _table.row(++_fetch_pos).to_row();
+        r = &_current;
+    }
+    else
+    {
+        _fetch_pos = 0;
+        _fetching = false;
+        return false;
+    }
+
+    return true;
+}
+
+bool statement::fetch(row_view &r)
+{
+	if(!_built) {build_result_set();} else if(!_fetching) {reset_iterator();}
+
+	if(_fetch_pos < _table.rows())
+    {
+        _fetching = true;
+        r = _table.row(++_fetch_pos);
+    }
+    else
+    {
+        _fetch_pos = 0;
+        _fetching = false;
+        return false;
+    }
+
+    return true;
+}
+
+// returns only a single row from the result set
+unordered_row statement::fetch_row(unsigned long row_id)
+{
+	if(!_built) build_result_set();
+	unordered_row r(0);
+
+	if(_table.rows() && row_id >= 1 && row_id <= _table.rows())
+	    return _table.row(row_id).to_row();
+
+	return r;
+}
+
+bool statement::fetch_row(unsigned long row_id, row_view &r)
+{
+	if(!_built) build_result_set();
+
+	if(row_id >= 1 && row_id <= _table.rows())
+	{
+		r = _table.row(row_id);
+		return true;
+	}
+
+	return false;
+}
+
+const result_set &statement::results()
+{
+	if(!_built) build_result_set();
+
+	return _table;
+}
+
+bool statement::fetch_direct(unordered_row &r)
+{
+	row_view v;
+
+	if(!fetch_direct(v)) return false;
+
+	r = v.to_row(_row_ptr);
+	return true;
+}
+
+// opens the cursor on the first row, after that every row comes out
+// of the same bound block so nothing is described or allocated again
+bool statement::fetch_direct(row_view &r)
+{
+    if(_executed && ready())
+    {
+        try
+        {
+			if(!open_cursor(_T("fetch_direct()")))
+			{
+				_row_ptr = 0;
+				return false;
+			}
+
+			bool more = _cursor.next();
+
+			take_failed_rows();
+
+			if(more)
+			{
+				_row_ptr = _cursor.row_id();
+				r = _cursor.current();
+				return true;
+			}
+
+			_rc = _cursor.last_status();
+			_cursor.close();
+        }
+        catch(_com_error &e)
+		{
+			_err = _T("_com_error: ") + e.Error();
+		}
+    }
+
+    _row_ptr = 0;
+    return false;
+}
+
+// fills block with the next rowset straight from the database, the
+// block keeps its column storage between calls so once it has grown to
+// a rowset nothing is allocated again
+bool statement::fetch_block(result_set &block)
+{
+    if(_executed && ready())
+    {
+        try
+        {
+			if(!open_cursor(_T("fetch_block()"))) return false;
+
+			if(block.schema_ptr() != _schema)
+				block.reset(_schema);
+			else
+				block.clear_rows();
+
+			bool more = _cursor.fetch_into(block);
+
+			take_failed_rows();
+
+			if(more)
+			{
+				_row_ptr += block.rows();
+				return true;
+			}
+
+			_rc = _cursor.last_status();
+			_cursor.close();
+        }
+        catch(_com_error &e)
+		{
+			_err = _T("_com_error: ") + e.Error();
+		}
+    }
+
+    _row_ptr = 0;
+    return false;
+}
+
+bool statement::execute_cached(TSTR sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							   const std::vector<TSTR> &tags)
+{
+	return run_cached(&sql_stmt, results, ttl, tags);
+}
+
+bool statement::execute_cached(std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							   const std::vector<TSTR> &tags)
+{
+	return run_cached(NULL, results, ttl, tags);
+}
+
+// the cursor appends rowsets to the batch until it is full, with
+// prefetch on the next rowsets are fetched while a batch is written
+bool statement::export_arrow(arrow_writer &w, size_t batch_rows)
+{
+	result_set batch;
+	bool more = true;
+
+    if(_executed && ready())
+    {
+        try
+        {
+			if(_cursor.is_open())
+			{
+				_err = _T("Failed to export, the result set is already being fetched");
+				return false;
+			}
+
+			_cursor.set_prefetch(_prefetch);
+			_cursor.set_metrics(metrics());
+
+			if(!_cursor.open(_hstmt, rowset_size(), true, false))
+			{
+				_rc = _cursor.last_status();
+				error(_T("export_arrow()"),_hstmt, SQL_HANDLE_STMT);
+				return false;
+			}
+
+			if(!w.is_open() && !w.begin(*_cursor.schema()))
+			{
+				_err = w.last_error();
+				_cursor.close();
+				return false;
+			}
+
+			batch.reset(_cursor.schema());
+
+			while(more)
+			{
+				while((more = _cursor.fetch_into(batch)) &&
+					  batch.rows() < batch_rows && batch.bytes() < ODBC_ARROW_BATCH_BYTES);
+
+				if(batch.rows() && !w.write(batch))
+				{
+					_err = w.last_error();
+					_cursor.close();
+					return false;
+				}
+
+				batch.clear_rows();
+			}
+
+			take_failed_rows();
+
+			_rc = _cursor.last_status();
+			_cursor.close();
+
+			if(!SQL_SUCCEEDED(_rc) && _rc != SQL_NO_DATA)
+			{
+				error(_T("export_arrow()"),_hstmt, SQL_HANDLE_STMT);
+				return false;
+			}
+
+			_rc = SQL_SUCCESS;
+			return true;
+        }
+        catch(_com_error &e)
+		{
+			_err = _T("_com_error: ") + e.Error();
+		}
+    }
+
+    return false;
+}
+
+bool statement::export_arrow(const TSTR &path, size_t batch_rows)
+{
+	std::ofstream out(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	arrow_writer w(out);
+
+	if(!out)
+	{
+		_err = _T("Failed to export, unable to open ") + path;
+		return false;
+	}
+
+	if(!export_arrow(w, batch_rows)) return false;
+
+	if(!w.end())
+	{
+		_err = w.last_error();
+		return false;
+	}
+
+	return true;
+}
+
+#if defined(ODBC_COROUTINES)
+row_generator statement::stream()
+{
+	row_view r;
+
+	while(fetch_direct(r))
+		co_yield r;
+}
+
+block_awaitable statement::next_block(result_set &block)
+{
+	return block_awaitable([this, &block]{ return fetch_block(block); }, block_awaitable::resumer());
+}
+
+block_awaitable statement::next_block(result_set &block, block_awaitable::resumer resume)
+{
+	return block_awaitable([this, &block]{ return fetch_block(block); }, resume);
+}
+#endif
+
+TSTR statement::get_field_name(unsigned long col)
+{
+	TSTR ret;
+
+	if(col >= 1 && col <= _fields)
+	{
+		ret = _schema->name(col);
+	}
+
+	return ret;
+}
+
+unsigned long statement::fields()
+{
+	return _fields;
+}
+
+unsigned long statement::rows()
+{
+	return _rows;
+}
+
+bool statement::move_to_result_set(unsigned long set_pos)
+{
+    if(_executed && ready())
+    {
+        //_rc = SQL_SUCCEEDED(SQLFetchScroll(_hstmt,SQL_FETCH_FIRST,set_pos));
+        _cursor.close();
+        _failed_rows = 0;
+        while(set_pos)
+        {
+            _rc = (SQLMoreResults(_hstmt)!=SQL_NO_DATA);
+            set_pos--;
+        }
+        return _rc;
+    }
+
+    return false;
+}
+
+unsigned long statement::failed_rows()
+{
+	return _failed_rows;
+}
+
+unsigned long statement::affected_rows()
+{
+    SQLLEN i;
+    if(_executed && ready())
+    {
+        _rc = SQL_SUCCEEDED(SQLRowCount(_hstmt,&i));
+        _affected_rows = i;
+    }
+
+	return _affected_rows;
+}
+
+void statement::set_rowset_size(SQLULEN rows)
+{
+	_rowset_size = rows ? rows : 1;
+}
+
+void statement::set_statement_rowset_size(SQLULEN rows)
+{
+	_stmt_rowset_size = rows;
+}
+
+SQLULEN statement::rowset_size()
+{
+	return _stmt_rowset_size ? _stmt_rowset_size : _rowset_size;
+}
+
+void statement::set_typed_fetch(bool typed)
+{
+	_typed = typed;
+}
+
+bool statement::typed_fetch()
+{
+	return _typed;
+}
+
+void statement::set_lob_streaming(bool stream)
+{
+	_stream_lobs = stream;
+}
+
+bool statement::lob_streaming()
+{
+	return _stream_lobs;
+}
+
+void statement::set_prefetch(size_t blocks)
+{
+	_prefetch = blocks;
+}
+
+size_t statement::prefetch()
+{
+	return _prefetch;
+}
+
+void statement::set_memory_budget(size_t bytes)
+{
+	_memory_budget = bytes;
+}
+
+size_t statement::memory_budget()
+{
+	return _memory_budget;
+}
+
+void statement::set_result_cache(std::shared_ptr<result_cache> cache)
+{
+	_result_cache = cache;
+}
+
+std::shared_ptr<result_cache> statement::get_result_cache()
+{
+	return _result_cache;
+}
+
+lob_reader statement::open_lob(SQLUSMALLINT col)
+{
+	return _cursor.open_lob(col);
+}
+
+lob_reader statement::open_lob(SQLUSMALLINT col, SQLSMALLINT c_type)
+{
+	return _cursor.open_lob(col, c_type);
+}
+
+void statement::set_statement_cache_size(size_t size)
+{
+	if(size < _stmt_cache.size()) clear_statement_cache();
+
+	_stmt_cache.set_capacity(size);
+}
+
+size_t statement::statement_cache_size()
+{
+	return _stmt_cache.capacity();
+}
+
+unsigned long statement::statement_cache_hits()
+{
+	return _stmt_cache.hits();
+}
+
+unsigned long statement::statement_cache_misses()
+{
+	return _stmt_cache.misses();
+}
+
+/******************
+* PRIVATE METHODS *
+*******************/
+
+bool statement::attach(odbc &conn)
+{
+	detach();
+
+	if(!conn._connected)
+	{
+		_rc = SQL_ERROR;
+		_err = _T("Failed to allocate statement, connection hasn't been established yet");
+		return false;
+	}
+
+	_rc = SQLAllocStmt(conn._hdbc, &_hstmt);
+
+	if(!SQL_SUCCEEDED(_rc))
+	{
+		conn._metrics.add(metric_errors);
+		_err = odbc::extract_error(_T("statement()"),conn._hdbc, SQL_HANDLE_DBC, conn._diag).to_string();
+		_hstmt = NULL;
+		return false;
+	}
+
+	_conn = &conn;
+
+	return true;
+}
+
+// cached handles go first, they were allocated on the same connection
+void statement::detach()
+{
+	if(_hstmt)
+	{
+		_cursor.close();
+		clear_statement_cache();
+		SQLFreeStmt(_hstmt, SQL_DROP);
+	}
+
+	_hstmt = NULL;
+	_conn = NULL;
+	forget_params();
+
+	init();
+}
+
+bool statement::ready()
+{
+	return _hstmt && _conn && _conn->_connected;
+}
+
+// settings like the rowset size and the cache capacity are left alone
+void statement::init()
+{
+	_fields = 0;
+	_rows = 0;
+	_row_ptr = 0;
+	_affected_rows = 0;
+	_failed_rows = 0;
+	_stmt_rowset_size = 0;
+	_params_processed = 0;
+	_fetch_pos = 0;
+	_plain_hstmt = NULL;
+	_stmt_cached = false;
+	_built = false;
+	_executed = false;
+	_bound = false;
+	_fetching = false;
+	_rc = SQL_SUCCESS;
+
+	_sql_stmt.clear();
+	_param_status.clear();
+	_schema.reset(new result_schema());
+	_table.clear();
+}
+
+// opens the cursor over the pending result set unless it already is
+bool statement::open_cursor(const TCHAR *fn)
+{
+	if(_cursor.is_open()) return true;
+
+	_cursor.set_prefetch(_prefetch);
+	_cursor.set_metrics(metrics());
+
+	if(!_cursor.open(_hstmt, rowset_size(), _typed, _stream_lobs))
+	{
+		_rc = _cursor.last_status();
+		error(fn,_hstmt, SQL_HANDLE_STMT);
+		return false;
+	}
+
+	_schema = _cursor.schema();
+	_fields = _cursor.fields();
+	_row_ptr = 0;
+
+	return true;
+}
+
+void statement::build_result_set()
+{
+    if(_executed && !_built && ready())
+    {
+        _fields = 0;
+        _rows = 0;
+
+        _schema.reset();
+		_table.set_memory_budget(_memory_budget);
+		_table.clear();
+
+        try
+        {
+			_cursor.set_prefetch(0);
+			_cursor.set_metrics(metrics());
+
+			if(_cursor.open(_hstmt, rowset_size(), _typed, false))
+			{
+				_schema = _cursor.schema();
+				_fields = _cursor.fields();
+				_table.reset(_schema);
+
+				while(_cursor.fetch_into(_table));
+
+				take_failed_rows();
+
+				_rc = _cursor.last_status();
+				_cursor.close();
+			}
+			else
+			{
+				_rc = _cursor.last_status();
+				error(_T("build_result_set()"),_hstmt, SQL_HANDLE_STMT);
+			}
+
+			_rows = _table.rows();
+        }
+        catch(_com_error &e)
+		{
+			_err = _T("_com_error: ") + e.Error();
+		}
+    }
+
+    _built = true;
+    _fetching = false;
+	_fetch_pos = 0;
+}
+
+// runs the bound arrays in one SQLExecute and then puts the statement
+// back to single parameter sets, the bindings only live for this call
+bool statement::execute_sets(SQLULEN sets)
+{
+	bool ret;
+
+	_param_status.assign(sets, SQL_PARAM_UNUSED);
+	_params_processed = 0;
+
+	if(!sets)
+	{
+		reset_params();
+		return true;
+	}
+
+	// closes the cursor of the last run as execute() does, some drivers
+	// refuse the paramset attributes while a cursor is open
+	_cursor.close();
+	SQLFreeStmt(_hstmt, SQL_CLOSE);
+
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)sets, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAM_STATUS_PTR, &_param_status[0], 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAMS_PROCESSED_PTR, &_params_processed, 0);
+
+	metrics_timer timer(metrics(), metric_execute);
+
+	_rc = SQLExecute(_hstmt);
+	ret = SQL_SUCCEEDED(_rc);
+	_conn->_metrics.add(metric_driver_calls, 2);
+
+	timer.stop();
+
+	if(!ret)
+		error(_T("execute_batch()"),_hstmt, SQL_HANDLE_STMT);
+
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAMSET_SIZE, (SQLPOINTER)1, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAM_STATUS_PTR, NULL, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAMS_PROCESSED_PTR, NULL, 0);
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_PARAM_BIND_TYPE, (SQLPOINTER)SQL_PARAM_BIND_BY_COLUMN, 0);
+	reset_params();
+
+	_built = false;
+	_failed_rows = 0;
+	_executed = ret;
+
+	return ret;
+}
+
+// a miss builds the result set as results() would and then swaps it
+// out of _table into the shared copy, so caching it copies nothing
+bool statement::run_cached(const TSTR *sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+						   const std::vector<TSTR> &tags)
+{
+	std::shared_ptr<result_set> built;
+	unsigned long long epoch = 0;
+	std::string key;
+
+	results.reset();
+
+	try
+	{
+		if(!ready())
+		{
+			_err = _T("Failed to execute, connection hasn't been established yet");
+			return false;
+		}
+
+		if(!sql_stmt && !_sql_stmt.size())
+		{
+			_err = _T("Failed to execute, no statement has been prepared");
+			return false;
+		}
+
+		if(_result_cache)
+		{
+			key = cache_key(sql_stmt ? *sql_stmt : _sql_stmt, !sql_stmt);
+			results = _result_cache->find(key, epoch);
+
+			if(results)
+			{
+				_rc = SQL_SUCCESS;
+				return true;
+			}
+		}
+
+		if(!(sql_stmt ? execute_direct(*sql_stmt) : execute())) return false;
+
+		build_result_set();
+
+		if(!SQL_SUCCEEDED(_rc) && _rc != SQL_NO_DATA)
+		{
+			error(_T("execute_cached()"),_hstmt, SQL_HANDLE_STMT);
+			return false;
+		}
+
+		built.reset(new result_set());
+		built->swap(_table);
+		_rows = 0;
+		_fetch_pos = 0;
+
+		if(_result_cache)
+			_result_cache->insert(key, built, ttl, tags, epoch);
+
+		results = built;
+		_rc = SQL_SUCCESS;
+		return true;
+	}
+	catch(_com_error &e)
+	{
+		_err = _T("_com_error: ") + e.Error();
+	}
+
+	return false;
+}
+
+// the DSN, login and typed fetch setting change what comes back for the
+// same SQL, grants and row level security differ by login, so all three
+// are part of the key, each parameter adds its types and the bytes it
+// points at now, which for bind_ref() is the caller's value
+std::string statement::cache_key(const TSTR &sql_stmt, bool params)
+{
+	TSTR sql = result_cache::normalize(sql_stmt);
+	std::string key;
+	size_t len;
+
+	len = _conn->_dsn.size();
+	key.append((const char*)&len, sizeof(len));
+	key.append((const char*)_conn->_dsn.data(), len*sizeof(TCHAR));
+	len = _conn->_uid.size();
+	key.append((const char*)&len, sizeof(len));
+	key.append((const char*)_conn->_uid.data(), len*sizeof(TCHAR));
+	key += _typed ? '1' : '0';
+	len = sql.size();
+	key.append((const char*)&len, sizeof(len));
+	key.append((const char*)sql.data(), len*sizeof(TCHAR));
+
+	for(size_t i=0;params && i<_params.size();++i)
+	{
+		const param_buffer *buf = _params[i].get();
+
+		if(!buf || !buf->bound) continue;
+
+		key.append((const char*)&i, sizeof(i));
+		key.append((const char*)&buf->c_type, sizeof(buf->c_type));
+		key.append((const char*)&buf->sql_type, sizeof(buf->sql_type));
+		key.append((const char*)&buf->indicator, sizeof(buf->indicator));
+
+		if(buf->indicator > 0)
+			key.append((const char*)buf->ptr, (size_t)buf->indicator);
+	}
+
+	return key;
+}
+
+// the rows are bound only for the call, so the statement can go on
+// to fetch_block() or another fetch_rows() with a different struct
+bool statement::fetch_mapped(const row_layout &layout, row_sink &rows, size_t max_rows)
+{
+    if(_executed && ready())
+    {
+        try
+        {
+			if(_cursor.is_open())
+			{
+				_err = _T("Failed to fetch rows, the result set is being streamed by fetch_direct()");
+				return false;
+			}
+
+			_cursor.set_metrics(metrics());
+
+			bool more = _cursor.fetch_rows(_hstmt, rowset_size(), layout, rows, max_rows);
+
+			take_failed_rows();
+
+			if(more) return true;
+
+			_rc = _cursor.last_status();
+
+			if(_cursor.unmapped_column().size())
+				_err = _T("Failed to fetch rows, the result set has no column ") + _cursor.unmapped_column();
+			else if(!SQL_SUCCEEDED(_rc) && _rc != SQL_NO_DATA)
+				error(_T("fetch_rows()"),_hstmt, SQL_HANDLE_STMT);
+        }
+        catch(_com_error &e)
+		{
+			_err = _T("_com_error: ") + e.Error();
+		}
+    }
+
+    return false;
+}
+
+// fixed values are copied into the inline slot, variable ones into data
+// which grows to the next power of 2 so a column bound with values of
+// varying length settles on one buffer, and on one binding as a size
+// of 0 takes the column size from its capacity
+bool statement::bind_buffer(SQLUSMALLINT col, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size, SQLSMALLINT decimals,
+							const void *data, SQLLEN length, bool fixed, const TCHAR *fn)
+{
+	SQLPOINTER ptr;
+	SQLLEN buffer_len;
+	size_t bytes, capacity;
+
+	if(!ready() || !_sql_stmt.size())
+	{
+		_err = _T("Failed to bind parameter, no statement has been prepared");
+		return false;
+	}
+
+	if(!col)
+	{
+		_err = _T("Failed to bind parameter, parameters are numbered from 1");
+		return false;
+	}
+
+	param_buffer &buf = param_slot(col);
+	bytes = data ? (size_t)length : 0;
+
+	if(fixed)
+	{
+		ptr = &buf.value;
+		buffer_len = sizeof(buf.value);
+	}
+	else
+	{
+		if(buf.data.size() < bytes || buf.data.empty())
+		{
+			for(capacity=64;capacity<bytes;capacity*=2);
+			buf.data.resize(capacity);
+		}
+
+		ptr = &buf.data[0];
+		buffer_len = (SQLLEN)buf.data.size();
+
+		if(!size)
+			size = buf.data.size() / (c_type == SQL_C_TCHAR ? sizeof(TCHAR) : 1);
+	}
+
+	if(bytes) memcpy(ptr, data, bytes);
+	buf.indicator = length;
+
+	return bind_parameter(col, buf, c_type, sql_type, size, decimals, ptr, buffer_len, fn);
+}
+
+bool statement::bind_pointer(SQLUSMALLINT col, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size, SQLSMALLINT decimals,
+							 SQLPOINTER ptr, SQLLEN length)
+{
+	if(!ready() || !_sql_stmt.size())
+	{
+		_err = _T("Failed to bind parameter, no statement has been prepared");
+		return false;
+	}
+
+	if(!col)
+	{
+		_err = _T("Failed to bind parameter, parameters are numbered from 1");
+		return false;
+	}
+
+	param_buffer &buf = param_slot(col);
+	buf.indicator = length;
+
+	return bind_parameter(col, buf, c_type, sql_type, size, decimals, ptr, length, _T("bind_ref()"));
+}
+
+// the indicator lives in buf so it is always bound, a binding that
+// matches the last one is left to the driver as it stands
+bool statement::bind_parameter(SQLUSMALLINT col, param_buffer &buf, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size,
+							   SQLSMALLINT decimals, SQLPOINTER ptr, SQLLEN buffer_len, const TCHAR *fn)
+{
+	if(buf.bound && buf.ptr == ptr && buf.buffer_len == buffer_len && buf.c_type == c_type &&
+	   buf.sql_type == sql_type && buf.size == size && buf.decimals == decimals)
+	{
+		_rc = SQL_SUCCESS;
+		_bound = true;
+		return true;
+	}
+
+	_rc = SQLBindParameter(_hstmt, col, SQL_PARAM_INPUT, c_type, sql_type, size, decimals, ptr, buffer_len, &buf.indicator);
+	_conn->_metrics.add(metric_driver_calls);
+
+	if(!SQL_SUCCEEDED(_rc))
+	{
+		error(fn,_hstmt, SQL_HANDLE_STMT);
+		buf.bound = false;
+		_bound = false;
+		return false;
+	}
+
+	buf.bound = true;
+	buf.c_type = c_type;
+	buf.sql_type = sql_type;
+	buf.size = size;
+	buf.decimals = decimals;
+	buf.ptr = ptr;
+	buf.buffer_len = buffer_len;
+	_bound = true;
+
+	return true;
+}
+
+// buffers are never freed while the statement lives, the driver may
+// still hold a pointer into one until its parameters are reset
+param_buffer &statement::param_slot(SQLUSMALLINT col)
+{
+	if(_params.size() < col) _params.resize(col);
+
+	std::unique_ptr<param_buffer> &slot = _params[col-1];
+
+	if(!slot) slot.reset(new param_buffer());
+
+	return *slot;
+}
+
+void statement::reset_params()
+{
+	SQLFreeStmt(_hstmt, SQL_RESET_PARAMS);
+	forget_params();
+}
+
+void statement::forget_params()
+{
+	std::vector<std::unique_ptr<param_buffer> >::iterator itr;
+
+	for(itr=_params.begin();itr!=_params.end();++itr)
+		if(*itr) (*itr)->bound = false;
+
+	_bound = false;
+}
+
+// a hit makes the cached handle active as it is, a miss prepares a new
+// handle and caches it, pushing out the least recently used one
+bool statement::prepare_cached(TSTR sql_stmt)
+{
+	SQLHANDLE hstmt = _stmt_cache.find(sql_stmt);
+	SQLHANDLE evicted;
+	bool hit = (hstmt != NULL);
+
+	if(!hit)
+	{
+		_rc = SQLAllocStmt(_conn->_hdbc, &hstmt);
+
+		if(!SQL_SUCCEEDED(_rc))
+		{
+			error(_T("prepare()"),_conn->_hdbc, SQL_HANDLE_DBC);
+			return false;
+		}
+
+		_rc = SQLPrepare(hstmt, (SQLTCHAR*)sql_stmt.c_str(), sql_stmt.size());
+		_conn->_metrics.add(metric_driver_calls, 2);
+
+		if(!SQL_SUCCEEDED(_rc))
+		{
+			error(_T("prepare()"),hstmt, SQL_HANDLE_STMT);
+			SQLFreeStmt(hstmt, SQL_DROP);
+			return false;
+		}
+	}
+
+	// the handle being replaced either goes back to the cache with
+	// its cursor closed or is parked, either way with its parameters
+	// unbound as their buffers now belong to the new handle
+	_cursor.close();
+
+	if(_stmt_cached)
+		SQLFreeStmt(_hstmt, SQL_CLOSE);
+	else
+		_plain_hstmt = _hstmt;
+
+	reset_params();
+
+	_hstmt = hstmt;
+	_stmt_cached = true;
+
+	if(!hit)
+	{
+		evicted = _stmt_cache.insert(sql_stmt, hstmt);
+		if(evicted) SQLFreeStmt(evicted, SQL_DROP);
+	}
+
+	_sql_stmt = sql_stmt;
+	_built = false;
+	_executed = false;
+
+	return true;
+}
+
+void statement::use_plain_statement()
+{
+	if(!_stmt_cached) return;
+
+	_cursor.close();
+	SQLFreeStmt(_hstmt, SQL_CLOSE);
+	reset_params();
+
+	_hstmt = _plain_hstmt;
+	_plain_hstmt = NULL;
+	_stmt_cached = false;
+}
+
+// a cached statement that is still active is lost along with the rest
+void statement::clear_statement_cache()
+{
+	std::vector<SQLHANDLE> handles;
+	std::vector<SQLHANDLE>::iterator itr;
+
+	if(_stmt_cached)
+	{
+		use_plain_statement();
+		_sql_stmt.clear();
+		_bound = false;
+		_executed = false;
+	}
+
+	_stmt_cache.clear(handles);
+
+	for(itr=handles.begin();itr!=handles.end();++itr)
+		SQLFreeStmt(*itr, SQL_DROP);
+}
+
+// only statement level async is used, connection level async would
+// switch every other statement on the connection into async mode too
+bool statement::begin_async()
+{
+	if(_conn->async_mode() != SQL_AM_STATEMENT) return false;
+
+	return SQL_SUCCEEDED(SQLSetStmtAttr(_hstmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_ON, 0));
+}
+
+bool statement::end_async(SQLRETURN rc, const TCHAR *fn)
+{
+	SQLSetStmtAttr(_hstmt, SQL_ATTR_ASYNC_ENABLE, (SQLPOINTER)SQL_ASYNC_ENABLE_OFF, 0);
+	_rc = rc;
+
+	if(!SQL_SUCCEEDED(_rc))
+	{
+		error(fn,_hstmt, SQL_HANDLE_STMT);
+		return false;
+	}
+
+	_built = false;
+	_failed_rows = 0;
+	_executed = true;
+	return true;
+}
+
+void statement::reset_iterator()
+{
+    _fetch_pos = 0;
+}
+
+odbc_metrics *statement::metrics()
+{
+	return _conn ? &_conn->_metrics : NULL;
+}
+
+// every failure on the statement goes through here so it is counted
+// and last_error() carries the SQLSTATE
+void statement::error(const TCHAR *fn, SQLHANDLE handle, SQLSMALLINT type)
+{
+	if(_conn) _conn->_metrics.add(metric_errors);
+
+	_err = odbc::extract_error(fn, handle, type, _diag).to_string();
+}
+
+// failed rows don't fail the fetch, the rows around them are still
+// returned, but they are counted as an error and last_error() says
+// how many were left out and why
+void statement::take_failed_rows()
+{
+	std::vector<diag_record> records;
+	std::basic_ostringstream<TCHAR> out;
+	unsigned long n = _cursor.take_failed_rows(records);
+	size_t i;
+
+	if(!n) return;
+
+	if(_conn) _conn->_metrics.add(metric_errors);
+
+	_failed_rows += n;
+
+	for(i=0;i<records.size();++i)
+		_diag.push(records[i]);
+
+	out << _T("Failed to fetch ") << n << _T(" rows, they were left out");
+	if(!records.empty()) out << _T(", ") << records[0].to_string();
+
+	_err = out.str();
+}
@@ -0,0 +1,445 @@
+/*
+  Name: statement.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: Statement created from an odbc connection
+               Each statement owns its handle, parameter bindings, cursor
+               and result set, so several can be active on one connection
+               where the driver allows it
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef STATEMENT_H
+#define STATEMENT_H
+
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include "cursor.h"
+#include "bind.h"
+#include "arrow.h"
+#include "stmt_cache.h"
+#include "result_cache.h"
+#include "async.h"
+#include "coro.h"
+
+class odbc;
+
+struct param
+{
+	SQLSMALLINT col;
+	TSTR val;
+	SQLSMALLINT type;
+	SQLULEN size;
+	SQLSMALLINT decimals;
+};
+
+// column-wise parameter array for execute_batch(), holds
+// one value per parameter set for a single placeholder
+struct param_array
+{
+	SQLSMALLINT col;
+	std::vector<TSTR> vals;
+	SQLSMALLINT type;
+	SQLULEN size;
+	SQLSMALLINT decimals;
+};
+
+// row-wise parameter binding for execute_batch(), value and indicator
+// point at the member of the first struct in the caller's array,
+// indicator can be NULL for fixed size values
+struct param_binding
+{
+	SQLSMALLINT col;
+	SQLSMALLINT c_type;
+	SQLSMALLINT type;
+	SQLULEN size;
+	SQLSMALLINT decimals;
+	SQLPOINTER value;
+	SQLLEN buffer_len;
+	SQLLEN *indicator;
+};
+
+// A statement must not be used across threads, and whether a second
+// statement can be active while another still has rows pending is up
+// to the driver, see SQL_MAX_CONCURRENT_ACTIVITIES
+class statement
+{
+	public:
+		// unattached statement, odbc attaches its own on connect()
+		statement();
+		// allocates a handle on a connected odbc, the rowset size, typed
+		// and lob streaming settings start out as the connection's
+		// The statement stays with conn, disconnect() frees its handle and
+		// the next connect() allocates a new one, anything prepared or
+		// bound before then has to be prepared and bound again
+		statement(odbc &conn);
+		// frees the handle unless the connection has already done so
+		~statement();
+
+		statement(const statement&) = delete;
+		statement &operator=(const statement&) = delete;
+
+		// returns whether the statement has a handle to run on
+		bool is_open();
+		// returns the statement handle
+		SQLHANDLE handle();
+
+		// returns the last return code for the last SQL operation
+		SQLRETURN last_status();
+		// returns a custom error message if any, driver failures read
+		// "function: [SQLSTATE] (native error) message"
+		TSTR last_error();
+		// returns the SQLSTATE of the newest diagnostic record
+		TSTR last_state();
+		// returns the most recent diagnostic records, oldest first
+		std::vector<diag_record> diagnostics();
+		void clear_diagnostics();
+
+		// prepares a SQL statement and then binds a list of parameters
+		// requires the list to be param structs to build the binding
+		bool prepare_and_bind(TSTR sql_stmt,std::vector<param> params);
+		// prepares a SQL statement, with the statement cache on the
+		// same SQL text reuses its prepared handle and skips SQLPrepare
+		bool prepare(TSTR sql_stmt);
+		// binds parameters to the prepared statement
+		bool bind_param(short col, TSTR val, short sql_field_type, SQLULEN col_size ,short decimal_pts);
+
+		// binds value as parameter col in its native type, see param_traits
+		// in bind.h, the value is copied into a buffer the statement keeps
+		// for the column so it can go out of scope before execute(), and
+		// binding the column again reuses the buffer and binding
+		//     stmt.bind(1, 42); stmt.bind(2, name); stmt.execute();
+		template<class T>
+		bool bind(SQLUSMALLINT col, const T &value)
+		{
+			typedef param_traits<T> traits;
+
+			return bind_buffer(col, traits::c_type(), traits::sql_type(), traits::size(value), traits::decimals(),
+							   traits::data(value), traits::length(value), traits::fixed);
+		}
+		// an empty optional binds NULL
+		template<class T>
+		bool bind(SQLUSMALLINT col, const std::optional<T> &value)
+		{
+			typedef param_traits<T> traits;
+
+			if(value) return bind(col, *value);
+
+			return bind_buffer(col, traits::c_type(), traits::sql_type(), traits::size(T()), traits::decimals(),
+							   NULL, SQL_NULL_DATA, traits::fixed);
+		}
+		bool bind(SQLUSMALLINT col, const TCHAR *value) { return bind(col, TSTRVIEW(value)); }
+
+		// binds value where it is, nothing is copied so it must stay in
+		// place until the statement is executed, the value at that point
+		// is what is sent, only fixed size types can be bound this way
+		template<class T>
+		bool bind_ref(SQLUSMALLINT col, T &value)
+		{
+			typedef param_traits<T> traits;
+
+			static_assert(traits::fixed && !std::is_same<T, bool>::value, "bind_ref() needs a fixed size type other than bool");
+
+			return bind_pointer(col, traits::c_type(), traits::sql_type(), traits::size(value), traits::decimals(),
+								&value, traits::length(value));
+		}
+
+		// executes the prepared statement once per parameter set in a single
+		// driver call, every param_array must hold the same number of values
+		bool execute_batch(std::vector<param_array> &params);
+		// executes the prepared statement for sets rows of a caller owned
+		// struct array, row_size is the size of one struct
+		bool execute_batch(std::vector<param_binding> &bindings, SQLULEN row_size, SQLULEN sets);
+		// returns the SQL_PARAM_* status of every set in the last batch
+		std::vector<SQLUSMALLINT> batch_status();
+		// returns the number of parameter sets processed by the last batch
+		SQLULEN batch_processed();
+
+		// drops the statement and its results and allocates a fresh
+		// handle, cached prepared handles are kept
+		void free_statement();
+
+		// executes a prepared statement
+		bool execute();
+		// executes a non-bindable statement
+		bool execute_direct(TSTR sql_stmt);
+
+		// run execute() and execute_direct() without blocking, drivers with
+		// statement level async mode are polled from the shared executor's
+		// poller thread, others run the blocking call on one of its workers,
+		// leave the statement alone until the future is ready
+		std::future<bool> execute_async();
+		std::future<bool> execute_direct_async(TSTR sql_stmt);
+		// builds the result set on a worker thread, the reference
+		// stays valid until the statement runs again
+		std::future<const result_set&> results_async();
+
+		// fetches a unordered_row at a time
+		bool fetch(unordered_row &r);
+		// fetches a unordered_row at a time by reference, the row
+		// is a copy that is replaced by the next fetch
+		bool fetch(unordered_row *&r);
+		// fetches a row_view at a time, the view points straight into
+		// the result set so no row data is copied
+		bool fetch(row_view &r);
+
+		// fetches a specific unordered_row from result set
+		unordered_row fetch_row(unsigned long row_id);
+		// points a row_view at a specific row of the result set
+		bool fetch_row(unsigned long row_id, row_view &r);
+
+		// returns the columnar result set, building it if necessary
+		const result_set &results();
+
+		// streams each row straight from the database without
+		// building the result set, memory stays constant
+		bool fetch_direct(unordered_row &r);
+		// streams each row as a view into the cursor's block buffer,
+		// the view is only valid until the next call
+		bool fetch_direct(row_view &r);
+
+		// streams the next rowset into block, replacing its rows, block
+		// can be reused for every call and must not be mixed with fetch_direct()
+		bool fetch_block(result_set &block);
+
+		// replaces rows with up to max_rows rows, 0 for every row left, as
+		// row_mapping<T> in row_map.h maps them, the driver writes straight
+		// into rows so nothing is built in between, false once the result
+		// set is done or on failure, must not be mixed with fetch_direct()
+		//     std::vector<trade> trades;
+		//     while(stmt.fetch_rows(trades, 10000)) ...
+		template<class T>
+		bool fetch_rows(std::vector<T> &rows, size_t max_rows = 0)
+		{
+			vector_row_sink<T> sink(rows);
+
+			rows.clear();
+
+			return fetch_mapped(row_layout_of<T>(), sink, max_rows);
+		}
+
+		// with a cache attached, hands back the result set cached for the
+		// same normalized SQL text, DSN, login and typed fetch setting
+		// without running anything, otherwise runs sql_stmt through
+		// execute_direct(), builds the result set and caches it for ttl
+		// under tags, see result_cache.h, results is shared with the cache
+		// and every other reader, the statement's own results() are left empty
+		//     std::shared_ptr<const result_set> rates;
+		//     stmt.execute_cached(_T("SELECT * FROM fx_rates"), rates, std::chrono::minutes(5), {_T("fx_rates")});
+		bool execute_cached(TSTR sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							const std::vector<TSTR> &tags = std::vector<TSTR>());
+		// the same for the prepared statement through execute(), the
+		// values of the bound parameters are part of the key
+		bool execute_cached(std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+							const std::vector<TSTR> &tags = std::vector<TSTR>());
+
+		// writes the rest of the result set to w as Arrow record batches,
+		// a batch is filled a rowset at a time until it has batch_rows rows
+		// or ODBC_ARROW_BATCH_BYTES of values and only it is held, columns
+		// are fetched in their native types whatever typed_fetch() says,
+		// begin() is called on w if it hasn't been, end() is left to the
+		// caller
+		bool export_arrow(arrow_writer &w, size_t batch_rows = ODBC_ARROW_BATCH_ROWS);
+		// writes the rest of the result set to an Arrow IPC file at path
+		bool export_arrow(const TSTR &path, size_t batch_rows = ODBC_ARROW_BATCH_ROWS);
+
+#if defined(ODBC_COROUTINES)
+		// lazily yields each row of fetch_direct(), a view
+		// is only valid until the generator is advanced
+		//     for(const row_view &r : stmt.stream()) ...
+		row_generator stream();
+		// co_await stmt.next_block(block) suspends the coroutine while
+		// fetch_block() runs on a worker, it resumes on that worker or
+		// through resume and yields whether a block was fetched
+		block_awaitable next_block(result_set &block);
+		block_awaitable next_block(result_set &block, block_awaitable::resumer resume);
+#endif
+
+		// returns a field name of a particular column
+		TSTR get_field_name(unsigned long col);
+
+        // moves the result set cursor to a specific result set
+        // once the result sets have been passed they will be lost!
+		bool move_to_result_set(unsigned long set_pos);
+
+		// returns the number of fields in the result set
+		unsigned long fields();
+		// returns the number of rows in the result set
+		unsigned long rows();
+		// returns the affected rows from statements like INSERT/DELETE/UPDATE
+		unsigned long affected_rows();
+		// returns the rows of the current result set the driver failed to
+		// fetch, they are left out of what the fetches return, last_error()
+		// and diagnostics() say why
+		unsigned long failed_rows();
+
+		// sets how many rows each SQLFetch returns on this statement
+		void set_rowset_size(SQLULEN rows);
+		// overrides the rowset size until free_statement()
+		void set_statement_rowset_size(SQLULEN rows);
+		// returns the rowset size the next fetch will use
+		SQLULEN rowset_size();
+
+		// fetches numeric, date/time and binary columns in their native C types
+		void set_typed_fetch(bool typed);
+		bool typed_fetch();
+
+		// leaves long columns to open_lob() when streaming with fetch_direct()
+		void set_lob_streaming(bool stream);
+		bool lob_streaming();
+		// reads up to blocks rowsets ahead on a background thread while
+		// fetch_direct() and fetch_block() work through the current one
+		void set_prefetch(size_t blocks);
+		size_t prefetch();
+		// heap bytes results() may take before the rest of the result set
+		// spills to a temporary memory mapped file, 0 is no limit, see
+		// odbc::set_memory_budget() for what outgrown buffers cost
+		void set_memory_budget(size_t bytes);
+		size_t memory_budget();
+		// opens a chunked reader over a long column of the current row
+		lob_reader open_lob(SQLUSMALLINT col);
+		lob_reader open_lob(SQLUSMALLINT col, SQLSMALLINT c_type);
+
+		// cache execute_cached() reads and fills, shared with any number of
+		// statements and connections, NULL (the default) turns it off
+		void set_result_cache(std::shared_ptr<result_cache> cache);
+		std::shared_ptr<result_cache> get_result_cache();
+
+		// keeps up to size prepared handles for this statement, 0 is off
+		void set_statement_cache_size(size_t size);
+		size_t statement_cache_size();
+		unsigned long statement_cache_hits();
+		unsigned long statement_cache_misses();
+
+	private:
+		friend class odbc;
+
+		// connection the handle was allocated on, NULL once detached
+        odbc *_conn;
+		// connection the statement was created on and is attached to
+		// again on its next connect(), NULL once it is destroyed
+        odbc *_owner;
+        SQLHANDLE _hstmt;
+
+		// err/info value and return code of the last operation
+        TSTR _err;
+        SQLRETURN _rc;
+		// diagnostic records of the failed calls on the handle
+		diag_buffer _diag;
+
+		TSTR _sql_stmt;
+
+		unsigned long _fields;
+        unsigned long _rows;
+		unsigned long _affected_rows;
+		unsigned long _row_ptr;
+		// rows left out of the current result set, reset on execute
+		unsigned long _failed_rows;
+
+		// rows per SQLFetch for the statement and the current run,
+		// a run value of 0 falls back to the statement value
+		SQLULEN _rowset_size;
+		SQLULEN _stmt_rowset_size;
+		// fetches columns in their native C types
+		bool _typed;
+		// leaves long columns to open_lob() when streaming
+		bool _stream_lobs;
+		// rowsets the cursor reads ahead when streaming, 0 is off
+		size_t _prefetch;
+		// heap bytes of the built result set before it spills, 0 is off
+		size_t _memory_budget;
+		// built result sets shared between statements, NULL is off
+		std::shared_ptr<result_cache> _result_cache;
+
+		// prepared handles by SQL text, while one of them is active in
+		// _hstmt the plain statement handle is parked in _plain_hstmt
+		statement_cache _stmt_cache;
+		SQLHANDLE _plain_hstmt;
+		bool _stmt_cached;
+		// buffers of the parameters bound through bind_param() and
+		// bind(), one per column from 1, only _hstmt is ever bound to them
+		std::vector<std::unique_ptr<param_buffer> > _params;
+		// per set status and processed count of the last batch
+		std::vector<SQLUSMALLINT> _param_status;
+		SQLULEN _params_processed;
+
+		bool _bound;
+		bool _built;
+		bool _executed;
+		bool _fetching;
+
+		// column descriptions and names of the active result set,
+		// owned once by the cursor and shared by every row built from it
+        std::shared_ptr<const result_schema> _schema;
+		// forward-only cursor over the active result set, used
+		// for streaming and for building the result set
+        cursor _cursor;
+		// materialized result set and the next row position to fetch
+        result_set _table;
+        unsigned long _fetch_pos;
+		// row handed out by fetch(unordered_row *&)
+        unordered_row _current;
+
+		// allocates the handle on conn
+		bool attach(odbc &conn);
+		// frees every handle, the statement is unusable until attached again
+		void detach();
+		// returns whether the handle and its connection are usable
+		bool ready();
+		// clears the state of the last statement run
+		void init();
+
+		// opens the cursor for streaming, fn names the caller in diagnostics
+		bool open_cursor(const TCHAR *fn);
+		void build_result_set();
+		// executes the bound parameter arrays as sets parameter sets
+		bool execute_sets(SQLULEN sets);
+		// prepares through the statement cache
+		bool prepare_cached(TSTR sql_stmt);
+		// makes the plain statement handle active again
+		void use_plain_statement();
+		// frees every cached statement handle
+		void clear_statement_cache();
+		void reset_iterator();
+		// turns on async mode for the handle if the driver supports it
+		bool begin_async();
+		// turns async mode back off and records how the call finished
+		bool end_async(SQLRETURN rc, const TCHAR *fn);
+		// runs and caches the statement for execute_cached(), sql_stmt is
+		// NULL for the prepared statement
+		bool run_cached(const TSTR *sql_stmt, std::shared_ptr<const result_set> &results, std::chrono::milliseconds ttl,
+						const std::vector<TSTR> &tags);
+		// builds the result cache key of the statement about to be run
+		std::string cache_key(const TSTR &sql_stmt, bool params);
+		// fetches rows through the cursor for fetch_rows()
+		bool fetch_mapped(const row_layout &layout, row_sink &rows, size_t max_rows);
+		// copies the value into the column's buffer and binds it, data
+		// NULL binds length as the indicator with nothing copied
+		bool bind_buffer(SQLUSMALLINT col, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size, SQLSMALLINT decimals,
+						 const void *data, SQLLEN length, bool fixed, const TCHAR *fn = _T("bind()"));
+		// binds a caller owned value, only the indicator is kept
+		bool bind_pointer(SQLUSMALLINT col, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size, SQLSMALLINT decimals,
+						  SQLPOINTER ptr, SQLLEN length);
+		// binds buf unless it is already bound exactly so
+		bool bind_parameter(SQLUSMALLINT col, param_buffer &buf, SQLSMALLINT c_type, SQLSMALLINT sql_type, SQLULEN size,
+							SQLSMALLINT decimals, SQLPOINTER ptr, SQLLEN buffer_len, const TCHAR *fn);
+		// returns the buffer of column col, creating it when needed
+		param_buffer &param_slot(SQLUSMALLINT col);
+		// unbinds every parameter of the active handle
+		void reset_params();
+		// forgets the bindings once the driver has dropped them
+		void forget_params();
+		// returns the connection's metrics, NULL once detached
+		odbc_metrics *metrics();
+		// counts the failure, collects the handle's diagnostics and
+		// sets last_error() from the first record
+		void error(const TCHAR *fn, SQLHANDLE handle, SQLSMALLINT type);
+		// picks up the rows the cursor left out of the last fetch
+		void take_failed_rows();
+};
+
+
+#endif
@@ -0,0 +1,98 @@
+/*
+  Name: stmt_cache.h
+  Copyright: Mark Zammit
+  Author: Mark Zammit
+  Date: 17/10/26
+  Description: LRU cache of prepared statement handles keyed by SQL text
+               A hit hands back a handle that is already prepared so the
+               driver doesn't parse and plan the statement again
+*/
+
+// Relies on the ODBC types, include through odbc.h
+
+#ifndef STMT_CACHE_H
+#define STMT_CACHE_H
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+
+class statement_cache
+{
+    public:
+        statement_cache() : _capacity(0), _hits(0), _misses(0) {}
+
+        // maximum number of handles kept, 0 turns the cache off
+        void set_capacity(size_t capacity) { _capacity = capacity; }
+        size_t capacity() const { return _capacity; }
+        // number of handles currently cached
+        size_t size() const { return _entries.size(); }
+
+        // returns the handle prepared for sql and marks it most recently
+        // used, NULL on a miss, every call counts as a hit or a miss
+        SQLHANDLE find(const TSTR &sql)
+        {
+            std::unordered_map<TSTR, entry_list::iterator>::iterator itr = _index.find(sql);
+
+            if(itr == _index.end())
+            {
+                ++_misses;
+                return NULL;
+            }
+
+            ++_hits;
+            _entries.splice(_entries.begin(), _entries, itr->second);
+
+            return itr->second->second;
+        }
+
+        // adds a freshly prepared handle as the most recently used and
+        // returns the least recently used handle it pushed out, or NULL,
+        // the caller owns and frees the returned handle
+        SQLHANDLE insert(const TSTR &sql, SQLHANDLE hstmt)
+        {
+            SQLHANDLE evicted = NULL;
+
+            _entries.push_front(std::make_pair(sql, hstmt));
+            _index[sql] = _entries.begin();
+
+            if(_entries.size() > _capacity && _entries.size() > 1)
+            {
+                evicted = _entries.back().second;
+                _index.erase(_entries.back().first);
+                _entries.pop_back();
+            }
+
+            return evicted;
+        }
+
+        // empties the cache into handles for the caller to free
+        void clear(std::vector<SQLHANDLE> &handles)
+        {
+            entry_list::iterator itr;
+
+            for(itr=_entries.begin();itr!=_entries.end();++itr)
+                handles.push_back(itr->second);
+
+            _entries.clear();
+            _index.clear();
+        }
+
+        // number of finds that returned a prepared handle and that didn't
+        unsigned long hits() const { return _hits; }
+        unsigned long misses() const { return _misses; }
+
+    private:
+        typedef std::list<std::pair<TSTR, SQLHANDLE> > entry_list;
+
+        size_t _capacity;
+        unsigned long _hits;
+        unsigned long _misses;
+
+        // most recently used at the front
+        entry_list _entries;
+        std::unordered_map<TSTR, entry_list::iterator> _index;
+};
+
+
+#endif
@@ -17,6 +17,8 @@
 #include <iostream>
 #include <map>
 #include <vector>
+#include <memory>
+#include <unordered_map>
 
 
 /** UNICODE SUPPORT **/
@@ -53,6 +55,7 @@
 
 #define FIELDPAIR std::pair<TSTR,field>
 #define FIELDVEC std::vector<FIELDPAIR >
+#define FIELDINDEX std::unordered_map<TSTR,size_t>
 
 // Prototypes
 class unordered_row;
@@ -364,7 +367,7 @@ class row : public std::map<TSTR,field>
         std::map<TSTR,field>::iterator _itr;
 
         // resets the internal pointer back to the start
-        void reset_iterator() { if(!(&_itr==&begin())) _itr = begin(); _reset = true; }
+        void reset_iterator() { _itr = begin(); _reset = true; }
 };
 
 // Unordered rows takes fields based on how they are inserted
@@ -379,6 +382,16 @@ class unordered_row : public FIELDVEC
 		unordered_row() { _id = 0; _locked = false; _id_locked = false; _reset = false; _itr = begin(); }
 		// initializes with a row ID#
         unordered_row(unsigned long id) { _id = id; _locked = false; _id_locked = true; _reset = false; _itr = begin();}
+        // initializes with a row ID# and a shared name => position index
+        // built once for a whole result set, fields must then be added in
+        // index order and both add_field and get_field become O(1)
+        unordered_row(unsigned long id, std::shared_ptr<const FIELDINDEX> index)
+        {
+            _id = id; _locked = false; _id_locked = true; _reset = false;
+            _index = index;
+            if(_index) reserve(_index->size());
+            _itr = begin();
+        }
         // initializes with a row ID# and an array of pre-defined fields
         unordered_row(unsigned long id, std::vector<field> fields)
         {
@@ -514,16 +527,30 @@ class unordered_row : public FIELDVEC
 		// a std::pair in the format of key:= field name, value:= field class
         FIELDVEC::iterator _itr;
 
+        // optional shared index of field name => position
+        std::shared_ptr<const FIELDINDEX> _index;
+
         // resets the internal pointer back to the start
-        void reset_iterator() { if(!(&_itr==&begin())) _itr = begin(); _reset = true; }
+        void reset_iterator() { _itr = begin(); _reset = true; }
 
-        // returns an iterator to an existing field through a sequential search
-        // as the vector is unordered and uses a string key
+        // returns an iterator to an existing field, names in the shared index
+        // are resolved directly when the field is at the indexed position,
+        // anything else through a sequential search as the vector is
+        // unordered and uses a string key, fields added out of schema order
+        // or moved by the vector's own methods fall through to the search
         // this is to make sure that fields are unique
-        FIELDVEC::iterator find(TSTR id)
+        FIELDVEC::iterator find(const TSTR &id)
         {
             FIELDVEC::iterator it;
 
+            if(_index)
+            {
+                FIELDINDEX::const_iterator pos = _index->find(id);
+
+                if(pos != _index->end() && pos->second < size() && (begin() + pos->second)->first == id)
+                    return begin() + pos->second;
+            }
+
             for(it=begin(); it!=end(); ++it)
             {
                 if(it->first==id) break;